@@ -65,6 +65,7 @@
 #define RegFiFoRxCurrentAddr	0x10
 #define RegIrqFlags				0x12
 #define RegRxNbBytes			0x13
+#define RegPktSnrValue			0x19
 #define RegPktRssiValue			0x1A
 #define	RegModemConfig1			0x1D
 #define RegModemConfig2			0x1E
@@ -82,8 +83,53 @@
 #define LORA_OK				200
 #define LORA_NOT_FOUND			404
 #define LORA_LARGE_PAYLOAD		413
+#define LORA_VERIFY_FAIL		417	// la lectura de verificacion no coincide con lo escrito
 #define LORA_UNAVAILABLE		503
 
+// Copia (shadow) de los registros de configuracion 0x01..0x41: LoRa_get / LoRa_update
+#define LORA_SHADOW_SIZE		(RegDioMapping2 + 1)
+#define LORA_VERIFY_TRIES		3
+#define LORA_READY_TIMEOUT		10	// ms del reset a que RegVersion responde (datasheet: 5 ms)
+
+// 1: main mide una rafaga a la FIFO de 64 y 255 bytes, bloqueante vs DMA (LoRa_benchBurst)
+#ifndef LORA_SPI_BENCH
+#define LORA_SPI_BENCH			0
+#endif
+
+struct LoRa_setting;
+
+// Fin de una rafaga por DMA (desde la ISR del DMA): ok = 0 si el HAL reporto error
+typedef void (*LoRa_spiDone)(struct LoRa_setting* _LoRa, uint8_t ok);
+
+#ifndef LORA_RX_SLOTS
+#define LORA_RX_SLOTS			4	// potencia de 2
+#endif
+#ifndef LORA_RX_MAX_LEN
+#define LORA_RX_MAX_LEN			64	// mas largo se trunca (pkt.rx_bytes dice cuanto era)
+#endif
+
+// Paquete recibido (LoRa_receivePacket / anillo de RX)
+typedef struct {
+	uint8_t		length;         // bytes copiados al buffer
+	uint8_t		rx_bytes;       // RegRxNbBytes (mayor que length si no entraba)
+	int16_t		rssi;           // dBm del paquete (corregido con el SNR si es negativo)
+	int8_t		snr_q2;         // SNR en pasos de 0.25 dB (RegPktSnrValue)
+	uint8_t		crc_ok;         // 0 si PayloadCrcError
+	uint32_t	t_ms;           // HAL_GetTick de RxDone (EXTI) o de la lectura
+} LoRa_packet;
+
+typedef struct {
+	LoRa_packet	pkt;
+	uint8_t		data[LORA_RX_MAX_LEN];
+} LoRa_rxSlot;
+
+// Fin de una transmision de LoRa_transmit_IT (desde la ISR de DIO0): ok = 0 si vencio el timeout
+typedef void (*LoRa_txDone)(struct LoRa_setting* _LoRa, uint8_t ok);
+
+#define LORA_TX_IDLE		0
+#define LORA_TX_LOADING		1	// FIFO cargandose por DMA
+#define LORA_TX_ON_AIR		2	// TRANSMIT_MODE, esperando TxDone en DIO0
+
 typedef struct LoRa_setting{
 	
 	// Hardware setings:
@@ -104,17 +150,69 @@ typedef struct LoRa_setting{
 	uint16_t		preamble;
 	uint8_t			power;
 	uint8_t			overCurrentProtection;
+
+	// SPI por DMA (LoRa_BurstWrite_DMA / LoRa_BurstRead_DMA):
+	volatile uint8_t	spi_busy;        // NSS abajo con una rafaga en curso
+	LoRa_spiDone		spi_done;
+	uint32_t			spi_t0;          // DWT al bajar NSS
+	uint32_t			spi_cpu_cycles;  // CPU que costo arrancar la ultima rafaga
+	uint32_t			spi_wall_cycles; // NSS abajo -> NSS arriba de la ultima rafaga
+
+	// Copia de los registros de configuracion (se invalida con LoRa_reset):
+	uint8_t				shadow[LORA_SHADOW_SIZE];
+	uint8_t				shadow_ok[(LORA_SHADOW_SIZE + 7) / 8];	// bit por registro: copia valida
+	uint32_t			shadow_skips;    // escrituras que no salieron (el valor ya estaba)
+	uint32_t			init_cycles;     // DWT (SYSCLK) que tardo el ultimo LoRa_init
+
+	// TX sin bloqueo (LoRa_transmit_IT):
+	volatile uint8_t	tx_state;        // LORA_TX_IDLE / LOADING / ON_AIR
+	LoRa_txDone			tx_done;
+	int					tx_mode;         // modo al que se vuelve al terminar
+	uint8_t				tx_dio_map;      // RegDioMapping1 de antes (DIO0 = RxDone)
+	uint16_t			tx_timeout;
+	uint32_t			tx_t0;           // HAL_GetTick al arrancar
+	uint32_t			tx_air_ms;       // carga + tiempo en el aire de la ultima
+	uint32_t			tx_errors;       // timeouts / errores de DMA
+
+	// RX por interrupcion (LoRa_startReceive_IT): pool fijo, anillo ISR -> main
+	int					rx_mode;         // 0 apagado, RXCONTIN_MODE o RXSINGLE_MODE
+	LoRa_rxSlot			rx_slots[LORA_RX_SLOTS];
+	volatile uint8_t	rx_head;         // lo avanza la ISR con el paquete completo
+	volatile uint8_t	rx_tail;         // lo avanza main (LoRa_rxRelease)
+	uint8_t				rx_pending;      // RxDone con el bus ocupado: lo atiende LoRa_SPI_CallBack
+	uint32_t			rx_pending_t;    // tick de ese RxDone
+	uint32_t			rx_packets;
+	uint32_t			rx_overflows;    // descartados con el anillo lleno
+	uint32_t			rx_crc_errors;   // descartados por PayloadCrcError
+	uint32_t			rx_errors;       // errores de DMA
 	
 } LoRa;
 
+typedef struct {
+	uint32_t	write_blocking;     // ciclos DWT (CPU ocupada = tiempo total)
+	uint32_t	write_dma_cpu;      // ciclos de CPU hasta que arranca el DMA
+	uint32_t	write_dma_wall;     // ciclos de NSS abajo a NSS arriba
+	uint32_t	read_blocking;
+	uint32_t	read_dma_cpu;
+	uint32_t	read_dma_wall;
+} LoRa_burstBench;
+
 LoRa newLoRa(void);
 void LoRa_reset(LoRa* _LoRa);
 void LoRa_readReg(LoRa* _LoRa, uint8_t* address, uint16_t r_length, uint8_t* output, uint16_t w_length);
 void LoRa_writeReg(LoRa* _LoRa, uint8_t* address, uint16_t r_length, uint8_t* values, uint16_t w_length);
 void LoRa_gotoMode(LoRa* _LoRa, int mode);
 uint8_t LoRa_read(LoRa* _LoRa, uint8_t address);
+uint8_t LoRa_get(LoRa* _LoRa, uint8_t address);
+uint8_t LoRa_update(LoRa* _LoRa, uint8_t address, uint8_t mask, uint8_t value);
+uint16_t LoRa_verify(LoRa* _LoRa);
 void LoRa_write(LoRa* _LoRa, uint8_t address, uint8_t value);
 void LoRa_BurstWrite(LoRa* _LoRa, uint8_t address, uint8_t *value, uint8_t length);
+uint8_t LoRa_BurstWrite_DMA(LoRa* _LoRa, uint8_t address, uint8_t *value, uint8_t length, LoRa_spiDone done);
+uint8_t LoRa_BurstRead_DMA(LoRa* _LoRa, uint8_t address, uint8_t *output, uint8_t length, LoRa_spiDone done);
+uint8_t LoRa_spiBusy(LoRa* _LoRa);
+void LoRa_SPI_CallBack(LoRa* _LoRa, uint8_t ok);
+void LoRa_benchBurst(LoRa* _LoRa, uint8_t length, LoRa_burstBench* out);
 uint8_t LoRa_isvalid(LoRa* _LoRa);
 
 void LoRa_setLowDaraRateOptimization(LoRa* _LoRa, uint8_t value);
@@ -126,9 +224,17 @@ void LoRa_setOCP(LoRa* _LoRa, uint8_t current);
 void LoRa_setTOMsb_setCRCon(LoRa* _LoRa);
 void LoRa_setSyncWord(LoRa* _LoRa, uint8_t syncword);
 uint8_t LoRa_transmit(LoRa* _LoRa, uint8_t* data, uint8_t length, uint16_t timeout);
+uint8_t LoRa_transmit_IT(LoRa* _LoRa, uint8_t* data, uint8_t length, uint16_t timeout, LoRa_txDone done);
+uint8_t LoRa_txBusy(LoRa* _LoRa);
+void LoRa_DIO0_CallBack(LoRa* _LoRa);
+void LoRa_SysTick_CallBack(LoRa* _LoRa);
 void LoRa_startReceiving(LoRa* _LoRa);
 uint8_t LoRa_receive(LoRa* _LoRa, uint8_t* data, uint8_t length);
-void LoRa_receive_IT(LoRa* _LoRa, uint8_t* data, uint8_t length);
+uint8_t LoRa_receivePacket(LoRa* _LoRa, uint8_t* data, uint8_t size, LoRa_packet* pkt);
+void LoRa_startReceive_IT(LoRa* _LoRa, int mode);
+void LoRa_stopReceive_IT(LoRa* _LoRa);
+const LoRa_rxSlot* LoRa_rxPeek(LoRa* _LoRa);
+void LoRa_rxRelease(LoRa* _LoRa);
 int LoRa_getRSSI(LoRa* _LoRa);
 
 uint16_t LoRa_init(LoRa* _LoRa);
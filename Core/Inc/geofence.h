@@ -0,0 +1,106 @@
+/*
+ * geofence.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Cercos virtuales evaluados en el collar con cada fix.
+ * Cada cerco es un poligono en coordenadas enteras (gps_coord_t, 1e-7 grados):
+ *   1) prefiltro por caja (bbox) calculada al cargar,
+ *   2) numero de cruces (crossing number) en enteros, sin divisiones.
+ * El cambio de estado (adentro / afuera) se confirma recien despues de
+ * GEOFENCE_HYST_FIXES fixes seguidos del mismo lado: el ruido sobre la linea no dispara.
+ *
+ * Costo por fix: a lo sumo GEOFENCE_MAX_POLYS * GEOFENCE_MAX_VERTS aristas
+ * (el peor caso medido queda en Geofence_GetStats().max_cycles).
+ */
+
+#ifndef INC_GEOFENCE_H_
+#define INC_GEOFENCE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gps.h"
+
+#define GEOFENCE_MAX_POLYS    4
+#define GEOFENCE_MAX_VERTS    16
+#define GEOFENCE_HYST_FIXES   3          // fixes seguidos para confirmar entrada / salida
+#define GEOFENCE_SPAN_MAX     50000000   // 5 grados: los productos del test entran en int64
+
+typedef enum {
+	GEOFENCE_KEEP_IN = 0,    // potrero: salir es alarma
+	GEOFENCE_KEEP_OUT        // zona prohibida (ruta, vecino): entrar es alarma
+} geofence_kind_t;
+
+typedef struct {
+	gps_coord_t lat;
+	gps_coord_t lon;
+} geofence_vertex_t;
+
+// Formato del cerco tanto en flash (const) como en la config bajada por LoRa
+typedef struct {
+	uint8_t id;
+	uint8_t kind;            // geofence_kind_t
+	uint8_t count;           // vertices usados (3..GEOFENCE_MAX_VERTS), el poligono se cierra solo
+	geofence_vertex_t v[GEOFENCE_MAX_VERTS];
+} geofence_poly_t;
+
+typedef enum {
+	GEOFENCE_OK = 0,
+	GEOFENCE_ERR_COUNT,      // mas de GEOFENCE_MAX_POLYS cercos
+	GEOFENCE_ERR_POLY        // menos de 3 vertices, demasiados o mas grande que GEOFENCE_SPAN_MAX
+} geofence_status_t;
+
+typedef enum {
+	GEOFENCE_EV_NONE = 0,
+	GEOFENCE_EV_EXIT,
+	GEOFENCE_EV_ENTER
+} geofence_event_type_t;
+
+typedef struct {
+	uint8_t id;              // id del cerco
+	uint8_t type;            // geofence_event_type_t
+	bool alarm;              // salida de KEEP_IN o entrada a KEEP_OUT
+	gps_coord_t lat;         // fix que confirmo el cambio
+	gps_coord_t lon;
+	uint32_t t_ms;
+} geofence_event_t;
+
+typedef struct {
+	uint32_t checks;         // fixes evaluados
+	uint32_t bbox_hits;      // poligonos que pasaron el prefiltro
+	uint32_t events;
+	uint32_t alarms;
+	uint32_t max_cycles;     // peor Geofence_Check medido (DWT)
+} geofence_stats_t;
+
+/**
+ * Sin cercos. Se cargan despues con Geofence_Load.
+ */
+void Geofence_Init(void);
+
+/**
+ * Reemplaza los cercos (se copian: la tabla puede estar en flash o en un buffer de recepcion).
+ * Si algun poligono no es valido no cambia nada.
+ */
+geofence_status_t Geofence_Load(const geofence_poly_t *polys, uint8_t count);
+
+/**
+ * Evalua un fix contra todos los cercos. Devuelve true si se confirmo algun cambio
+ * (queda pendiente hasta Geofence_EventSent).
+ */
+bool Geofence_Check(gps_coord_t lat, gps_coord_t lon, uint32_t t_ms);
+
+/**
+ * Primer evento pendiente, las alarmas antes que el resto. false si no hay.
+ */
+bool Geofence_PendingEvent(geofence_event_t *ev);
+
+/**
+ * Marca como enviado el evento del cerco id (si no cambio de nuevo mientras tanto).
+ */
+void Geofence_EventSent(const geofence_event_t *ev);
+
+geofence_stats_t Geofence_GetStats(void);
+
+#endif /* INC_GEOFENCE_H_ */
@@ -5,70 +5,157 @@
  *      Author: Bulanov Konstantin
  */
 
+#ifndef INC_GPS_H_
+#define INC_GPS_H_
+
+#include "stm32f1xx_hal.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include "ubx.h"
+
 #define	GPS_USART	&huart1
-#define GPSBUFSIZE  128       // GPS buffer size
+#define GPSBUFSIZE  96        // GPS buffer size (por slot: NMEA maximo 82 caracteres)
+#define GPS_SENTENCE_SLOTS 16 // slots de la cola ISR -> main (potencia de 2)
+#define GPS_DMA_RX_SIZE 256   // buffer circular del DMA de USART1 (HT cada 128 bytes)
+#define GPS_UBX_MAX_LEN 512   // payload UBX mas largo que se saltea; mas largo es un sync falso (ruido)
+
+// Velocidad del enlace con el receptor.
+// GPS_Process busca al modulo (autobaud sobre GPS_BAUD_CANDIDATES) y lo sube a GPS_BAUD_TARGET
+// con CFG-PRT, en el motor UBX: GPS_Init no bloquea. Sin receptor queda a 9600.
+// Con SYSCLK = 16 MHz el error de BRR es < 0.1 % hasta 115200.
+#ifndef GPS_BAUD_TARGET
+#define GPS_BAUD_TARGET 115200
+#endif
+#define GPS_BAUD_CANDIDATES { 9600, 115200, 38400, 57600, 19200, 4800 }
+#define GPS_LINK_PROBE_MS  300    // espera de la respuesta a cada probe (con un reintento)
+#define GPS_LINK_SWITCH_MS 100    // CFG-PRT: salida del frame a 4800 + el cambio en el receptor
+#define GPS_LOAD_WINDOW_MS 1000   // ventana de medicion de uso del enlace
+
+// Protocolo de salida del receptor
+#define GPS_MODE_NMEA   0     // GGA + RMC en ASCII
+#define GPS_MODE_UBX    1     // mensajes NAV binarios, sin parseo de texto
+#ifndef GPS_MODE
+#define GPS_MODE        GPS_MODE_NMEA
+#endif
+
+// Generacion del receptor para GPS_MODE_UBX:
+// 6 -> NAV-POSLLH + NAV-VELNED + NAV-TIMEUTC + NAV-STATUS, 7 u 8 -> NAV-PVT
+#ifndef GPS_UBX_GEN
+#define GPS_UBX_GEN     6
+#endif
+
+// Filtro alfa-beta de la posicion entre el armado de epocas y GPS_GetFix (ver gps_filter.h)
+#ifndef GPS_FILTER_ENABLE
+#define GPS_FILTER_ENABLE  1
+#endif
+
+// Tasa de medicion segun el movimiento (CFG-RATE en ejecucion, solo con GPS_PWR_CONTINUOUS).
+// En los modos de ahorro (GPS_PWR_*) la tasa queda fija en GPS_RATE_MID_MS y el periodo lo
+// pone updatePeriod de CFG-PM2: los dos controladores no le mandan cosas distintas al receptor.
+// Sube apenas hay movimiento y baja despues de un tiempo sin el (histeresis por tiempo).
+// Con staticHoldThresh de NAV5 el receptor reporta velocidad 0 mientras el animal esta quieto.
+#define GPS_RATE_FAST_MS       200      // caminando: 5 Hz
+#define GPS_RATE_MID_MS        1000     // pastoreo: 1 Hz
+#define GPS_RATE_SLOW_MS       10000    // echado: 0.1 Hz
+#define GPS_RATE_WALK_KN       2000     // knots x1000 (~3.7 km/h)
+#define GPS_RATE_MOVE_KN       300      // knots x1000 (~0.55 km/h)
+#define GPS_RATE_UP_FIXES      2        // fixes seguidos caminando para pasar a 5 Hz
+#define GPS_RATE_WALK_HOLD_MS  20000    // sin caminar este tiempo: 5 Hz -> 1 Hz
+#define GPS_RATE_REST_MS       300000   // sin moverse este tiempo: 1 Hz -> 0.1 Hz
+#define GPS_RATE_HDOP_MAX      500      // x100: con un fix peor no se baja la tasa
+#define GPS_RATE_PDOP_MAX      800      // x100: idem cuando solo hay pDOP (NAV-PVT), pDOP >= HDOP
+
+// Ahorro de energia del receptor segun el intervalo de reporte (GPS_SetReportInterval):
+//   intervalo <  GPS_PWR_CYCLIC_MIN_MS  -> continuo
+//   intervalo <  GPS_PWR_ONOFF_MIN_MS   -> cyclic tracking (CFG-PM2, sigue los satelites)
+//   intervalo <  GPS_PWR_BACKUP_MIN_MS  -> ON/OFF (CFG-PM2, se apaga entre fixes)
+//   intervalo >= GPS_PWR_BACKUP_MIN_MS  -> backup por tiempo (RXM-PMREQ) despues de cada fix
+// Fuera de continuo se apaga la tasa segun el movimiento (GPS_RATE_*): CFG-RATE a 1 Hz.
+typedef enum {
+	GPS_PWR_CONTINUOUS = 0,
+	GPS_PWR_CYCLIC,
+	GPS_PWR_ONOFF,
+	GPS_PWR_BACKUP
+} gps_pwr_mode_t;
+
+#define GPS_PWR_CYCLIC_MIN_MS   1000     // periodo minimo de CFG-PM2
+#define GPS_PWR_ONOFF_MIN_MS    10000    // u-blox 6/7 pasan solos a ON/OFF por encima de 10 s
+#define GPS_PWR_BACKUP_MIN_MS   600000
+#define GPS_PWR_SILENCE_MS      2000     // ON/OFF y backup: sin bytes del receptor = dormido
+#define GPS_PWR_HOLD_MS         2000     // backup: despierto despues del fix antes de dormir
+#define GPS_PWR_FIX_TIMEOUT_MS  120000   // backup: sin fix en este tiempo se vuelve a dormir igual
+#define GPS_PWR_MIN_SLEEP_MS    5000
+#define GPS_PWR_WAKE_GRACE_MS   5000     // backup: si no desperto a tiempo se lo despierta por RX
+
+// Coordenada en enteros de 1e-7 grados (como u-blox en UBX).
+// +-180 grados = +-1.8e9 entra en int32; 1e-7 grados son ~1.1 cm de latitud.
+// Con float de 24 bits de mantisa, a nuestras latitudes el paso era de ~0.4 m.
+typedef int32_t gps_coord_t;
+#define GPS_COORD_SCALE 10000000L   // 1 grado
+
+// Helpers de signo / hemisferio (negativo = S u W)
+static inline gps_coord_t gps_coord_apply_hemi(gps_coord_t c, char nsew){
+    return (nsew == 'S' || nsew == 'W') ? -c : c;
+}
+static inline char gps_coord_lat_hemi(gps_coord_t lat){ return (lat < 0) ? 'S' : 'N'; }
+static inline char gps_coord_lon_hemi(gps_coord_t lon){ return (lon < 0) ? 'W' : 'E'; }
+static inline gps_coord_t gps_coord_abs(gps_coord_t c){ return (c < 0) ? -c : c; }
 
 typedef struct{
 
-    // calculated values
-    float dec_longitude;
-    float dec_latitude;
-    float altitude_ft;
-
-    // GGA - Global Positioning System Fixed Data
-    float nmea_longitude;
-    float nmea_latitude;
-    float utc_time;
-    char ns, ew;
-    int lock;
+    // posicion (GGA)
+    gps_coord_t latitude;    // 1e-7 grados, S negativo
+    gps_coord_t longitude;   // 1e-7 grados, W negativo
+    int32_t altitude_cm;     // altura MSL
+    uint32_t utc_time;       // hhmmss.sss x1000
+    int lock;                // calidad del fix (0 = sin fix)
     int satelites;
-    float hdop;
-    float msl_altitude;
-    char msl_units;
+    uint16_t hdop;           // x100 (0 = desconocido: NAV-PVT no lo trae)
 
     // RMC - Recommended Minimmum Specific GNS Data
-    char rmc_status;
-    float speed_k;
-    float course_d;
-    int date;
-
-    // GLL
-    char gll_status;
-
-    // VTG - Course over ground, ground speed
-    float course_t; // ground speed true
-    char course_t_unit;
-    float course_m; // magnetic
-    char course_m_unit;
-    char speed_k_unit;
-    float speed_km; // speek km/hr
-    char speed_km_unit;
+    char rmc_status;         // 'A' o 'V'
+    uint32_t speed_k;        // knots x1000
+    uint32_t course_d;       // degrees x100
+    int date;                // ddmmyy
+
+    // solo en GPS_MODE_UBX (en NMEA quedan en 0)
+    uint8_t fix_type;        // 0 sin fix, 2 = 2D, 3 = 3D
+    uint32_t h_acc_mm;       // precision horizontal estimada
+    uint16_t pdop;           // x100, solo NAV-PVT (0 = desconocido)
+
+    // latitude/longitude salen del filtro (GPS_FILTER_ENABLE); aca la medicion del receptor
+    gps_coord_t raw_latitude;
+    gps_coord_t raw_longitude;
+    uint8_t filter;          // gps_filter_result_t de esta epoca
+
+    uint32_t tick_ms;        // HAL_GetTick del primer byte de la epoca (para timebase.c)
 } GPS_t;
 
 
 
 
+// Todo en enteros escalados (el M3 no tiene FPU): ver escala en cada campo
 typedef struct{
-	    float nmea_longitude;
-	    float nmea_latitude;
-	    float utc_time;
-	    char ns, ew;
-	    int lock;
+	    uint32_t utc_time;       // hhmmss.sss x1000 (ej: 123519250 = 12:35:19.250)
+	    gps_coord_t latitude;    // 1e-7 grados, ya con el signo de ns
+	    gps_coord_t longitude;   // 1e-7 grados, ya con el signo de ew
+	    char ns, ew;             // '\0' si el campo vino vacio
+	    int lock;                // calidad del fix (0 = sin fix)
 	    int satelites;
-	    float hdop;
-	    float msl_altitude;
+	    uint16_t hdop;           // x100
+	    int32_t msl_altitude;    // x100 (cm si msl_units = 'M')
 	    char msl_units;
 } GPS_GGA;
 
 typedef struct {
-		double utc_time;       // hhmmss.sss
+		uint32_t utc_time;       // hhmmss.sss x1000
 		char status;           // 'A' o 'V'
-		double nmea_latitude;  // ddmm.mmmm
+		gps_coord_t latitude;    // 1e-7 grados, ya con el signo de ns
 		char ns;               // 'N'/'S'
-		double nmea_longitude; // dddmm.mmmm
+		gps_coord_t longitude;   // 1e-7 grados, ya con el signo de ew
 		char ew;               // 'E'/'W'
-		float speed_k;         // knots
-		float course_d;        // degrees
+		uint32_t speed_k;        // knots x1000
+		uint32_t course_d;       // degrees x100
 		int date;              // ddmmyy (ej: 230394)
 } GPS_RMC;
 
@@ -76,6 +163,51 @@ typedef struct {
 
 
 
+// Contadores de recepcion, para medir carga de interrupciones y de CPU.
+// Antes (Receive_IT de 1 byte) habia 1 interrupcion por byte: rx_events == rx_bytes.
+// Con DMA circular + IDLE: rx_events ~ epocas/s + rx_bytes/(GPS_DMA_RX_SIZE/2).
+// Carga de CPU del callback = rx_cycles / (SystemCoreClock * segundos).
+typedef struct {
+    uint32_t rx_events;    // eventos HT/TC/IDLE atendidos
+    uint32_t rx_bytes;     // bytes consumidos del buffer DMA
+    uint32_t rx_cycles;    // ciclos de CPU acumulados dentro del callback (DWT)
+    uint32_t rx_restarts;  // rearmes del DMA despues de un error de UART (ORE, etc.)
+    uint32_t isr_max_cycles; // peor tiempo medido de un evento de RX (cota del ISR)
+
+    uint32_t sentences;    // sentencias encoladas por la ISR
+    uint32_t ubx_frames;   // frames UBX encolados por la ISR
+    uint32_t dropped_full; // descartadas porque la cola estaba llena (overflow)
+    uint32_t dropped_long; // descartadas por no entrar en un slot
+    uint32_t checksum_errors; // rechazadas en la ISR al cerrar el campo "*hh"
+    uint32_t malformed;    // sin '*', hex invalido o basura antes del fin de linea
+    uint32_t filtered;     // tipos NMEA sin handler, descartados en la ISR
+    uint32_t parse_max_cycles; // peor GPS_parse medido (DWT)
+    uint32_t fixes;        // epocas completas publicadas
+    uint32_t epochs_partial; // epocas descartadas porque falto alguna sentencia
+    uint32_t filter_outliers;  // saltos descartados por el filtro de posicion
+    uint32_t filter_resets;
+    uint32_t filter_max_cycles; // peor gps_filter_update medido (DWT)
+
+    uint32_t cfg_errors;   // CFG de GPS_Init que terminaron en NAK/timeout
+    uint8_t  cfg_polls_ok; // settings que el receptor contesto en el arranque
+    uint8_t  cfg_changed;  // settings reenviados (0 = arranque en caliente, sin CFG ni BBR)
+    uint32_t baud;         // velocidad del enlace (0 si no se encontro el receptor)
+    uint16_t link_load_pm; // uso del enlace en la ultima ventana: tiempo de byte ocupado, por mil
+    uint16_t link_load_max_pm; // peor ventana medida (margen = 1000 - este valor)
+
+    uint16_t rate_ms;      // periodo de medicion pedido al receptor
+    uint32_t rate_changes; // CFG-RATE enviados por el control de tasa
+
+    uint8_t  pwr_mode;     // gps_pwr_mode_t en uso
+    uint32_t wakes;        // veces que el receptor volvio a hablar despues de dormir
+    uint32_t rx_resyncs;   // reinicios del armado de sentencias al despertar
+    uint32_t ttff_last_ms; // tiempo al primer fix despues del ultimo despertar (o del arranque)
+    uint32_t ttff_max_ms;
+    uint32_t ttff_timeouts; // despertares sin fix en GPS_PWR_FIX_TIMEOUT_MS
+} GPS_Stats_t;
+
+
+
 #if (GPS_DEBUG == 1)
 void GPS_print(char *data);
 #endif
@@ -94,8 +226,20 @@ void save_config();
 void GPS_Init();
 
 void GPS_print_val(char *data, int value);
-void GPS_UART_CallBack();
-int GPS_validate(char *nmeastr);
+void GPS_UART_CallBack(uint16_t rx_pos);
+void GPS_UART_TxCallBack(void);
+void GPS_UART_ErrorCallBack(void);
+GPS_Stats_t GPS_GetStats(void);
+void GPS_Process(void);
+bool GPS_GetFix(GPS_t *out, uint32_t *seq);
+ubx_status_t GPS_ApplyUbxConfig_Runtime(void);
+void GPS_SetReportInterval(uint32_t interval_ms);
+bool GPS_TakeSleep(void);
 void GPS_parse(char *GPSstrParse);
-float GPS_nmea_to_dec(float deg_coord, char nsew);
+gps_coord_t GPS_nmea_to_coord(const char *field, uint8_t len, char nsew);
+
+// Ultimo fix completo publicado por GPS_Process. Leer con GPS_GetFix().
+extern GPS_t GPS;
+
+#endif /* INC_GPS_H_ */
 
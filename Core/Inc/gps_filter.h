@@ -0,0 +1,66 @@
+/*
+ * gps_filter.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Filtro alfa-beta (velocidad constante) de la posicion, todo en enteros.
+ * Trabaja en un plano local en mm (este / norte) alrededor de un origen que se
+ * recentra solo; cada actualizacion es un numero fijo de operaciones (sin lazos).
+ *
+ * La ganancia sale de la calidad de la medicion: con HDOP bajo y muchos satelites
+ * el filtro sigue al receptor, con HDOP alto confia mas en la prediccion.
+ * Un salto que implica mas velocidad que GPS_FILTER_VMAX_MM_S se descarta (outlier);
+ * si se repite GPS_FILTER_MAX_REJECTS veces seguidas el filtro se reinicia ahi.
+ */
+
+#ifndef INC_GPS_FILTER_H_
+#define INC_GPS_FILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gps.h"
+
+#define GPS_FILTER_VMAX_MM_S    8000     // vaca a la carrera (~29 km/h)
+#define GPS_FILTER_GATE_MM      5000     // + ruido admitido por unidad de HDOP
+#define GPS_FILTER_MAX_REJECTS  5
+#define GPS_FILTER_RESET_MS     30000    // sin fixes este tiempo (receptor dormido): reiniciar
+#define GPS_FILTER_RECENTER_MM  5000000  // 5 km del origen: recentrar el plano local
+#define GPS_FILTER_ALPHA_Q8     128      // ganancia de posicion con HDOP 1.0 (0.5)
+#define GPS_FILTER_ALPHA_MIN_Q8 16
+
+typedef enum {
+	GPS_FILTER_INIT = 0,    // primer fix (o reinicio): sale tal cual
+	GPS_FILTER_OK,          // medicion incorporada
+	GPS_FILTER_OUTLIER,     // salto descartado: sale la prediccion
+	GPS_FILTER_RESET        // demasiados outliers seguidos: se reinicio en la medicion
+} gps_filter_result_t;
+
+typedef struct {
+	bool init;
+	gps_coord_t lat0, lon0;     // origen del plano local
+	int32_t cos_q15;            // cos(lat0) en Q15
+	int32_t x_mm, y_mm;         // posicion estimada (este, norte)
+	int32_t vx_mm_s, vy_mm_s;   // velocidad estimada
+	uint32_t t_ms;              // HAL_GetTick de la ultima actualizacion
+	uint8_t rejects;            // outliers seguidos
+
+	uint32_t updates;
+	uint32_t outliers;
+	uint32_t resets;
+} gps_filter_t;
+
+void gps_filter_reset(gps_filter_t *f);
+
+// cos(lat) en Q15 (Bhaskara, error < 0.2 %); escala este-oeste del plano local
+int32_t gps_filter_cos_q15(gps_coord_t lat);
+
+/**
+ * Incorpora una medicion y deja en *lat / *lon la posicion filtrada.
+ * hdop x100 (0 = desconocido, se toma 2.0), t_ms = HAL_GetTick del primer byte de la
+ * epoca (GPS_t.tick_ms): la demora del parseo no entra en dt.
+ */
+gps_filter_result_t gps_filter_update(gps_filter_t *f, gps_coord_t *lat, gps_coord_t *lon,
+                                      uint16_t hdop, uint8_t sats, uint32_t t_ms);
+
+#endif /* INC_GPS_FILTER_H_ */
@@ -36,6 +36,7 @@ typedef enum {
 
 typedef struct {
     uint32_t      t_ms;       // timestamp (HAL_GetTick)
+    uint64_t      epoch_ms;   // UTC en ms (timebase.h), 0 si todavía no hay hora del GPS
     int32_t       temp_mC;    // 37250 => 37.250°C (0 si inválida)
     temp_status_t status;     // OK / TIMEOUT / CRC / ...
 } temp_sample_t;
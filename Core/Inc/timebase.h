@@ -0,0 +1,59 @@
+/*
+ * timebase.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Hora UTC (epoch en ms) disciplinada por el GPS.
+ * HAL_GetTick corre con el HSI (hasta +-1 % de error) y arranca en 0 con cada reset:
+ * cada fix con fecha y hora validas (RMC 'A' o NAV-TIMEUTC) ancla el epoch al tick
+ * en que llego el primer byte de la epoca, y entre anclas se corrige el tick con la
+ * deriva medida (ppm) contra el GPS. Si hay pin de timepulse, Timebase_OnPulse
+ * da el borde del segundo exacto y saca la latencia de salida del receptor.
+ */
+
+#ifndef INC_TIMEBASE_H_
+#define INC_TIMEBASE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gps.h"
+
+#define TIMEBASE_DRIFT_MIN_MS   60000   // base minima entre anclas para medir deriva (1 ms / 60 s ~ 17 ppm)
+#define TIMEBASE_DRIFT_MAX_PPM  30000   // mas que esto es un salto de hora, no deriva
+#define TIMEBASE_GPS_LATENCY_MS 0       // del borde del segundo al primer byte (sin timepulse); calibrar por receptor
+
+typedef struct {
+	bool     valid;             // hay al menos un ancla
+	uint32_t syncs;             // anclas tomadas
+	uint32_t pulse_syncs;       // de esas, con timepulse
+	int32_t  drift_ppm;         // deriva del tick respecto del GPS (+ = el tick adelanta)
+	int32_t  last_error_ms;     // prediccion - GPS al re-anclar
+	int32_t  max_error_ms;      // |last_error_ms| maximo
+} timebase_stats_t;
+
+void Timebase_Init(void);
+
+/**
+ * Ancla con un fix publicado (usa date, utc_time y tick_ms). Ignora fixes sin fecha/hora.
+ */
+void Timebase_OnFix(const GPS_t *fix);
+
+/**
+ * Borde de un segundo UTC del timepulse (desde la EXTI); el fix que sigue dice cual.
+ */
+void Timebase_OnPulse(uint32_t tick);
+
+/**
+ * Epoch UTC en ms de un HAL_GetTick (0 si todavia no hay hora).
+ */
+uint64_t Timebase_TickToEpochMs(uint32_t tick);
+
+/**
+ * Epoch UTC en ms de ahora (0 si todavia no hay hora).
+ */
+uint64_t Timebase_NowEpochMs(void);
+
+timebase_stats_t Timebase_GetStats(void);
+
+#endif /* INC_TIMEBASE_H_ */
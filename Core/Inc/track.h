@@ -0,0 +1,74 @@
+/*
+ * track.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Simplificacion del recorrido en linea, antes de la cola de uplink.
+ * Se queda solo con los puntos que hacen falta para reconstruir el recorrido
+ * con un error acotado, todo en enteros y con memoria fija:
+ *
+ *  - banda muerta: un fix a menos de deadband_mm del ultimo punto guardado se
+ *    descarta (vaca echada o pastoreando en el lugar).
+ *  - ventana abierta (opening window) de hasta TRACK_WINDOW puntos: mientras el
+ *    segmento ancla -> fix nuevo pase a menos de eps_mm de todos los puntos de la
+ *    ventana no se emite nada; cuando alguno queda afuera se emite el fix anterior
+ *    y pasa a ser el ancla.
+ *
+ * Error maximo entre un fix y el recorrido emitido: eps_mm + deadband_mm.
+ * Ademas se emite un punto cada TRACK_MAX_HOLD_MS aunque no haya movimiento
+ * (acota la latencia y sirve de "sigo vivo") o cuando la ventana se llena.
+ * Costo por fix: a lo sumo TRACK_WINDOW distancias punto-segmento y una raiz entera.
+ */
+
+#ifndef INC_TRACK_H_
+#define INC_TRACK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "gps.h"
+
+#define TRACK_WINDOW        32       // 12 bytes por punto
+#define TRACK_EPS_MM        5000     // error admitido respecto del segmento
+#define TRACK_DEADBAND_MM   2000     // fixes mas cerca que esto del ultimo guardado se descartan
+#define TRACK_MAX_HOLD_MS   120000   // un punto al menos cada 2 min
+#define TRACK_SPAN_MAX      900000   // ~10 km en 1e-7 grados: mas lejos del ancla se corta (evita desbordes)
+
+typedef struct {
+	gps_coord_t lat;
+	gps_coord_t lon;
+	uint32_t t_ms;
+} track_point_t;
+
+typedef struct {
+	bool init;
+	track_point_t anchor;             // ultimo punto emitido
+	track_point_t win[TRACK_WINDOW];  // puntos desde el ancla, sin emitir
+	uint8_t n;
+	int32_t cos_q15;                  // cos(lat) del ancla
+	int32_t eps;                      // en 1e-7 grados de latitud
+	int32_t deadband;
+
+	uint32_t points_in;
+	uint32_t points_out;
+	uint32_t deadband_drops;
+} track_t;
+
+/**
+ * Arranca la simplificacion con el error (eps_mm) y la banda muerta dados.
+ */
+void track_init(track_t *t, uint32_t eps_mm, uint32_t deadband_mm);
+
+/**
+ * Agrega un fix. Deja en out los puntos clave a emitir, en orden, y devuelve
+ * cuantos son (0, 1 o 2: el que cierra el segmento anterior y el fix mismo).
+ */
+uint8_t track_push(track_t *t, gps_coord_t lat, gps_coord_t lon, uint32_t t_ms, track_point_t out[2]);
+
+/**
+ * Emite el ultimo punto pendiente (antes de dormir el GPS o de apagar).
+ * Devuelve false si no habia nada sin emitir.
+ */
+bool track_flush(track_t *t, track_point_t *out);
+
+#endif /* INC_TRACK_H_ */
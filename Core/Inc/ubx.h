@@ -10,6 +10,8 @@
 
 #include "stm32f1xx_hal.h"
 #include <stdint.h>
+#include <stdbool.h>
+#include "ubx_frame.h"
 
 
 typedef enum {
@@ -18,7 +20,8 @@ typedef enum {
     UBX_ERR_TIMEOUT,      // no llegó ACK a tiempo
     UBX_ERR_BAD_CKSUM,    // llegó ACK corrupto (checksum mal)
     UBX_ERR_TX,           // falló el transmit por UART
-    UBX_ERR_PARAM         // body mal armado (len inconsistente, etc.)
+    UBX_ERR_PARAM,        // body mal armado (len inconsistente, etc.)
+    UBX_ERR_BUSY          // cola de configuracion llena
 } ubx_status_t;
 
 
@@ -31,50 +34,217 @@ typedef enum {
     case UBX_ERR_BAD_CKSUM: return "BAD_CKSUM";
     case UBX_ERR_TX:        return "TX_FAIL";
     case UBX_ERR_PARAM:     return "PARAM_FAIL";
+    case UBX_ERR_BUSY:      return "BUSY";
     default:                return "UNKNOWN";
     }
 }
 
 
+// Clases / IDs
+#define UBX_CLASS_NAV       0x01
+#define UBX_CLASS_RXM       0x02
+#define UBX_CLASS_ACK       0x05
+#define UBX_CLASS_CFG       0x06
+#define UBX_ID_CFG_PRT      0x00
+#define UBX_ID_CFG_MSG      0x01
+#define UBX_ID_CFG_RATE     0x08
+#define UBX_ID_CFG_CFG      0x09
+#define UBX_ID_CFG_RXM      0x11
+#define UBX_ID_CFG_NAV5     0x24
+#define UBX_ID_CFG_PM2      0x3B
+#define UBX_ID_RXM_PMREQ    0x41
+#define UBX_ID_NAV_POSLLH   0x02
+#define UBX_ID_NAV_STATUS   0x03
+#define UBX_ID_NAV_PVT      0x07
+#define UBX_ID_NAV_VELNED   0x12
+#define UBX_ID_NAV_TIMEUTC  0x21
+
+// Largos de payload
+#define UBX_LEN_CFG_PRT     20
+#define UBX_LEN_CFG_MSG     8
+#define UBX_LEN_CFG_RATE    6
+#define UBX_LEN_CFG_CFG     13
+#define UBX_LEN_CFG_RXM     2
+#define UBX_LEN_CFG_NAV5    36
+#define UBX_LEN_CFG_PM2     44
+#define UBX_LEN_RXM_PMREQ   8
+#define UBX_LEN_NAV_PVT     92
+#define UBX_LEN_NAV_POSLLH  28
+#define UBX_LEN_NAV_STATUS  16
+#define UBX_LEN_NAV_VELNED  36
+#define UBX_LEN_NAV_TIMEUTC 20
+
+// Frames completos (sync + header + payload + checksum), ver ubx_frame.h
 /* CFG-RATE (0x06 0x08) len=6: 5 Hz (200 ms) */
-extern const uint8_t UBX_CFGRATE_5HZ[10];
+extern const uint8_t UBX_CFGRATE_5HZ[UBX_FRAME_SIZE(UBX_LEN_CFG_RATE)];
 
 
 // habilitar estos mensajes
-extern const uint8_t UBX_CFGMSG_GGA_UART1_ON_BODY[12];
-extern const uint8_t UBX_CFGMSG_RMC_UART1_ON_BODY[12];
+extern const uint8_t UBX_CFGMSG_GGA_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_RMC_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
 
 //desabilitar estos
-extern const uint8_t UBX_CFGMSG_GLL_UART1_OFF_BODY[12];
-extern const uint8_t UBX_CFGMSG_GSA_UART1_OFF_BODY[12];
-extern const uint8_t UBX_CFGMSG_GSV_UART1_OFF_BODY[12];
-extern const uint8_t UBX_CFGMSG_VTG_UART1_OFF_BODY[12];
+extern const uint8_t UBX_CFGMSG_GGA_UART1_OFF[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_RMC_UART1_OFF[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_GLL_UART1_OFF[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_GSA_UART1_OFF[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_GSV_UART1_OFF[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_VTG_UART1_OFF[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+
+// Modo binario: mensajes NAV por UART1 (rate 1 = uno por epoca)
+extern const uint8_t UBX_CFGMSG_NAVPVT_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];     // u-blox 7/M8 en adelante
+extern const uint8_t UBX_CFGMSG_NAVPOSLLH_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];  // u-blox 6
+extern const uint8_t UBX_CFGMSG_NAVVELNED_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_NAVTIMEUTC_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
+extern const uint8_t UBX_CFGMSG_NAVSTATUS_UART1_ON[UBX_FRAME_SIZE(UBX_LEN_CFG_MSG)];
 
 //Pasar a modo Pedestrian y rango de utilizacion.
-extern const uint8_t UBX_CFGNAV5_CATTLE_BODY[40];
+extern const uint8_t UBX_CFGNAV5_CATTLE[UBX_FRAME_SIZE(UBX_LEN_CFG_NAV5)];
 
 //persistencia de configuraciones
 //Guardar configuraciones y que persistan en memoria
-extern const uint8_t UBX_CFGCFG_SAVE_ALL_BBR[17];
+extern const uint8_t UBX_CFGCFG_SAVE_ALL_BBR[UBX_FRAME_SIZE(UBX_LEN_CFG_CFG)];
 //volver a configuraciones de fabrica
-extern const uint8_t UBX_CFGCFG_FACTORY_DEFAULTS_BBR[17];
+extern const uint8_t UBX_CFGCFG_FACTORY_DEFAULTS_BBR[UBX_FRAME_SIZE(UBX_LEN_CFG_CFG)];
+
+//poll de CFG-PRT (UART1): contesta CFG-PRT + ACK si hay receptor a la velocidad actual
+extern const uint8_t UBX_POLL_CFGPRT_UART1[UBX_FRAME_SIZE(1)];
+
+
+// Lectura de campos little endian del payload
+static inline uint16_t ubx_get_u16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] | ((uint16_t)p[1] << 8));
+}
+static inline uint32_t ubx_get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+static inline int32_t ubx_get_i32(const uint8_t *p)
+{
+    return (int32_t)ubx_get_u32(p);
+}
 
 
 /**
- * Envía un UBX y espera ACK/NAK del mensaje (cls/id) del body.
+ * Arma un frame en RAM (para mensajes con campos que se calculan en ejecucion).
+ * Devuelve el largo del frame o 0 si no entra en size.
+ */
+uint16_t ubx_frame_build(uint8_t *out, uint16_t size, uint8_t cls, uint8_t id,
+                         const uint8_t *payload, uint16_t payload_len);
+
+// Envio bloqueante de un frame completo en una sola transmision
+ubx_status_t ubx_send_frame(UART_HandleTypeDef *huart, const uint8_t *frame,
+		uint16_t frame_len, uint32_t timeout_ms);
+
+/**
+ * Envía un frame UBX y espera ACK/NAK del mensaje (cls/id).
  * Valida checksum del ACK recibido.
  */
-ubx_status_t ubx_send_body_wait_ack(UART_HandleTypeDef *huart,
-		const uint8_t *body, uint16_t body_len, uint32_t tx_timeout_ms,
+ubx_status_t ubx_send_frame_wait_ack(UART_HandleTypeDef *huart,
+		const uint8_t *frame, uint16_t frame_len, uint32_t tx_timeout_ms,
 		uint32_t ack_timeout_ms);
 
 
+/**
+ * CFG-PRT sobre UART1: 8N1, entrada y salida UBX+NMEA, baudrate nuevo.
+ * No espera ACK: el receptor cambia de velocidad apenas procesa el mensaje
+ * y el ACK puede salir a cualquiera de las dos velocidades (o perderse).
+ * ubx_build_cfg_prt_uart1 arma el mismo frame para mandarlo por el motor (ubx_cfg_submit).
+ */
+uint16_t ubx_build_cfg_prt_uart1(uint8_t *out, uint16_t size, uint32_t baud);
+ubx_status_t ubx_set_uart1_baud(UART_HandleTypeDef *huart, uint32_t baud, uint32_t tx_timeout_ms);
+
+/**
+ * Poll de CFG-PRT (UART1): el receptor responde con CFG-PRT + ACK-ACK.
+ * UBX_OK significa que hay un receptor hablando a la velocidad actual de la UART.
+ */
+ubx_status_t ubx_probe(UART_HandleTypeDef *huart, uint32_t ack_timeout_ms);
+
+// CFG-RATE con periodo de medicion en ejecucion (navRate y timeRef como UBX_CFGRATE_5HZ)
+uint16_t ubx_build_cfg_rate(uint8_t *out, uint16_t size, uint16_t meas_ms);
+
+// ---- Ahorro de energia (CFG-PM2 / CFG-RXM / RXM-PMREQ) ----
+// Flags de CFG-PM2: waitTimeFix + updateRTC + updateEPH (el receptor mantiene
+// RTC y efemerides al dia en los periodos despierto, para que el proximo fix sea hot start)
+#define UBX_PM2_FLAGS_BASE    0x00001C00u
+#define UBX_PM2_MODE_CYCLIC   0x00020000u   // solo u-blox M8; en 6/7 son bits reservados
+
+/**
+ * CFG-PM2: update_ms es el periodo entre fixes y search_ms la espera antes de reintentar
+ * si no hubo fix. En u-blox 6/7 el receptor elige cyclic tracking si update_ms <= 10 s
+ * y ON/OFF si es mayor. Devuelven el largo del frame armado en out (0 si no entra).
+ */
+uint16_t ubx_build_cfg_pm2(uint8_t *out, uint16_t size, uint32_t flags,
+                           uint32_t update_ms, uint32_t search_ms);
+// CFG-RXM: power_save = false -> continuo (maxima performance), true -> lpMode 1 (usa CFG-PM2)
+uint16_t ubx_build_cfg_rxm(uint8_t *out, uint16_t size, bool power_save);
+// RXM-PMREQ: backup por duration_ms y despertar solo. No tiene ACK.
+uint16_t ubx_build_rxm_pmreq(uint8_t *out, uint16_t size, uint32_t duration_ms);
+
+// ---- Motor de configuracion no bloqueante ----
+// Los CFG se encolan y salen uno detras de otro por DMA (un frame por transferencia), con hasta
+// UBX_CFG_WINDOW esperando ACK a la vez. Los ACK-ACK/ACK-NAK que entrega el receptor
+// por el camino de RX (DMA) se asocian al pedido mas viejo con la misma class/id.
+// Los timeouts y reintentos se resuelven en ubx_cfg_poll() con HAL_GetTick; el siguiente
+// envio sale tambien desde HAL_UART_TxCpltCallback y desde cada ACK (sin esperar al main loop).
+#define UBX_CFG_QUEUE_LEN  16   // pedidos encolados (potencia de 2)
+#define UBX_CFG_WINDOW     4    // pedidos en vuelo esperando ACK
+#define UBX_CFG_BACKOFF_MS 80   // espera antes de reenviar despues de un timeout
+
+typedef struct {
+    uint32_t submitted;
+    uint32_t sent;        // transmisiones (incluye reintentos)
+    uint32_t acked;
+    uint32_t naked;
+    uint32_t timeouts;    // pedidos que agotaron los reintentos
+    uint32_t retries;
+} ubx_cfg_stats_t;
+
+/**
+ * Encola un CFG. frame tiene que seguir valido hasta que el pedido termine
+ * (tablas const o buffers static armados con ubx_frame_build). No bloquea.
+ */
+ubx_status_t ubx_cfg_submit(const uint8_t *frame, uint16_t frame_len,
+                            uint8_t retries, uint32_t ack_timeout_ms);
+
+// Respuesta a un poll: class/id y payload del frame que contesto el receptor
+typedef void (*ubx_frame_cb_t)(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len);
+
+/**
+ * Encola un poll (o cualquier mensaje que devuelva un frame antes del ACK).
+ * cb se llama desde la ISR de RX de USART1 (el framer de gps.c), con las IRQ apagadas y el
+ * payload todavia en el buffer de la ISR: tiene que ser corto, no bloquear y copiar lo que
+ * necesite. Puede encolar otro pedido. El pedido termina con el ACK.
+ */
+ubx_status_t ubx_poll_submit(const uint8_t *frame, uint16_t frame_len,
+                             uint8_t retries, uint32_t ack_timeout_ms, ubx_frame_cb_t cb);
+
+// Frame UBX recibido que no es NAV ni ACK (lo entrega el framer de gps.c, en la ISR de RX)
+void ubx_on_frame(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len);
+
+// Avanza el motor: envios, timeouts y reintentos. Los envios los encadenan el fin de TX
+// (HAL_UART_TxCpltCallback) y cada ACK/respuesta en la ISR de RX; desde el main loop
+// (GPS_Process) solo hace falta para los timeouts, reintentos y el backoff.
+void ubx_cfg_poll(UART_HandleTypeDef *huart);
+
+// ACK-ACK (ack_id = 0x01) o ACK-NAK (0x00) recibido para cls/id.
+void ubx_cfg_on_ack(uint8_t ack_id, uint8_t cls, uint8_t id);
+
+// true cuando no queda nada encolado ni esperando ACK
+bool ubx_cfg_idle(void);
+
+// Pedidos terminados con error (NAK/timeout/TX) desde la ultima llamada
+uint8_t ubx_cfg_take_errors(void);
+
+ubx_cfg_stats_t ubx_cfg_get_stats(void);
+
 // --- Recover: deja la UART limpia para reintentos
 void ubx_uart_recover(UART_HandleTypeDef *huart, uint32_t drain_ms);
 
 // --- Envío con reintentos (solo reintenta transitorios)
 ubx_status_t gps_send_cfg_retry(UART_HandleTypeDef *huart,
-                                       const uint8_t *body, uint16_t len,
+                                       const uint8_t *frame, uint16_t len,
                                        uint8_t retries,
                                        uint32_t tx_to, uint32_t ack_to);
 
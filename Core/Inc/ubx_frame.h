@@ -0,0 +1,134 @@
+/*
+ * ubx_frame.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#ifndef INC_UBX_FRAME_H_
+#define INC_UBX_FRAME_H_
+
+/*
+ * Frames UBX completos armados por el preprocesador:
+ *
+ *   const uint8_t X[] = UBX_FRAME(cls, id, payload...);
+ *
+ * expande a { 0xB5, 0x62, cls, id, lenL, lenH, payload..., CK_A, CK_B } con el largo y el
+ * Fletcher calculados en compilacion (son expresiones constantes). El frame queda en flash
+ * listo para salir en una sola transferencia.
+ *
+ * Fletcher sobre los N bytes b[0..N-1] = cls, id, lenL, lenH, payload:
+ *   CK_A = sum(b[i])             (mod 256)
+ *   CK_B = sum((N - i) * b[i])   (mod 256)
+ * UBX__FE pasa a cada elemento la cantidad de bytes que faltan (N - i), que es su peso en CK_B.
+ *
+ * Payload de 1 a UBX_FRAME_MAX_PAYLOAD bytes; para polls sin payload usar UBX_FRAME_POLL.
+ *
+ * UBX_DEFINE ademas compara la cantidad de bytes de payload contra el largo del mensaje
+ * (UBX_LEN_*) con un _Static_assert: un byte de mas o de menos no compila.
+ */
+
+#define UBX_FRAME_SIZE(payload_len)  ((payload_len) + 8)
+#define UBX_FRAME_MAX_PAYLOAD        60
+
+#define UBX_FRAME(cls, id, ...) { \
+    0xB5, 0x62, (cls), (id), UBX_NARGS(__VA_ARGS__), 0x00, __VA_ARGS__, \
+    UBX__CK((cls), (id), UBX_NARGS(__VA_ARGS__), 0x00, __VA_ARGS__) }
+
+#define UBX_DEFINE(name, payload_len, cls, id, ...) \
+    _Static_assert(UBX_NARGS(__VA_ARGS__) == (payload_len), #name ": largo de payload incorrecto"); \
+    const uint8_t name[UBX_FRAME_SIZE(payload_len)] = UBX_FRAME(cls, id, __VA_ARGS__)
+
+#define UBX_FRAME_POLL(cls, id) { \
+    0xB5, 0x62, (cls), (id), 0x00, 0x00, \
+    (uint8_t)((cls) + (id)), (uint8_t)(4 * (cls) + 3 * (id)) }
+
+// ---- internos ----
+#define UBX__CK(...) \
+    (uint8_t)(UBX__FE(UBX__ADD_A, __VA_ARGS__) 0), \
+    (uint8_t)(UBX__FE(UBX__ADD_B, __VA_ARGS__) 0)
+#define UBX__ADD_A(w, b)  (b) +
+#define UBX__ADD_B(w, b)  (w) * (b) +
+
+#define UBX__CAT(a, b)   UBX__CAT_(a, b)
+#define UBX__CAT_(a, b)  a##b
+#define UBX__FE(m, ...)  UBX__CAT(UBX__FE_, UBX_NARGS(__VA_ARGS__))(m, __VA_ARGS__)
+
+// cantidad de argumentos (1..64)
+#define UBX_NARGS(...)  UBX__NARGS_(__VA_ARGS__, \
+    64, 63, 62, 61, 60, 59, 58, 57, 56, 55, 54, 53, 52, 51, 50, 49, \
+    48, 47, 46, 45, 44, 43, 42, 41, 40, 39, 38, 37, 36, 35, 34, 33, \
+    32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, \
+    16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1)
+#define UBX__NARGS_( \
+    _1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, \
+    _17, _18, _19, _20, _21, _22, _23, _24, _25, _26, _27, _28, _29, _30, _31, _32, \
+    _33, _34, _35, _36, _37, _38, _39, _40, _41, _42, _43, _44, _45, _46, _47, _48, \
+    _49, _50, _51, _52, _53, _54, _55, _56, _57, _58, _59, _60, _61, _62, _63, _64, N, ...) N
+
+#define UBX__FE_1(m, b)       m(1, b)
+#define UBX__FE_2(m, b, ...)  m(2, b) UBX__FE_1(m, __VA_ARGS__)
+#define UBX__FE_3(m, b, ...)  m(3, b) UBX__FE_2(m, __VA_ARGS__)
+#define UBX__FE_4(m, b, ...)  m(4, b) UBX__FE_3(m, __VA_ARGS__)
+#define UBX__FE_5(m, b, ...)  m(5, b) UBX__FE_4(m, __VA_ARGS__)
+#define UBX__FE_6(m, b, ...)  m(6, b) UBX__FE_5(m, __VA_ARGS__)
+#define UBX__FE_7(m, b, ...)  m(7, b) UBX__FE_6(m, __VA_ARGS__)
+#define UBX__FE_8(m, b, ...)  m(8, b) UBX__FE_7(m, __VA_ARGS__)
+#define UBX__FE_9(m, b, ...)  m(9, b) UBX__FE_8(m, __VA_ARGS__)
+#define UBX__FE_10(m, b, ...)  m(10, b) UBX__FE_9(m, __VA_ARGS__)
+#define UBX__FE_11(m, b, ...)  m(11, b) UBX__FE_10(m, __VA_ARGS__)
+#define UBX__FE_12(m, b, ...)  m(12, b) UBX__FE_11(m, __VA_ARGS__)
+#define UBX__FE_13(m, b, ...)  m(13, b) UBX__FE_12(m, __VA_ARGS__)
+#define UBX__FE_14(m, b, ...)  m(14, b) UBX__FE_13(m, __VA_ARGS__)
+#define UBX__FE_15(m, b, ...)  m(15, b) UBX__FE_14(m, __VA_ARGS__)
+#define UBX__FE_16(m, b, ...)  m(16, b) UBX__FE_15(m, __VA_ARGS__)
+#define UBX__FE_17(m, b, ...)  m(17, b) UBX__FE_16(m, __VA_ARGS__)
+#define UBX__FE_18(m, b, ...)  m(18, b) UBX__FE_17(m, __VA_ARGS__)
+#define UBX__FE_19(m, b, ...)  m(19, b) UBX__FE_18(m, __VA_ARGS__)
+#define UBX__FE_20(m, b, ...)  m(20, b) UBX__FE_19(m, __VA_ARGS__)
+#define UBX__FE_21(m, b, ...)  m(21, b) UBX__FE_20(m, __VA_ARGS__)
+#define UBX__FE_22(m, b, ...)  m(22, b) UBX__FE_21(m, __VA_ARGS__)
+#define UBX__FE_23(m, b, ...)  m(23, b) UBX__FE_22(m, __VA_ARGS__)
+#define UBX__FE_24(m, b, ...)  m(24, b) UBX__FE_23(m, __VA_ARGS__)
+#define UBX__FE_25(m, b, ...)  m(25, b) UBX__FE_24(m, __VA_ARGS__)
+#define UBX__FE_26(m, b, ...)  m(26, b) UBX__FE_25(m, __VA_ARGS__)
+#define UBX__FE_27(m, b, ...)  m(27, b) UBX__FE_26(m, __VA_ARGS__)
+#define UBX__FE_28(m, b, ...)  m(28, b) UBX__FE_27(m, __VA_ARGS__)
+#define UBX__FE_29(m, b, ...)  m(29, b) UBX__FE_28(m, __VA_ARGS__)
+#define UBX__FE_30(m, b, ...)  m(30, b) UBX__FE_29(m, __VA_ARGS__)
+#define UBX__FE_31(m, b, ...)  m(31, b) UBX__FE_30(m, __VA_ARGS__)
+#define UBX__FE_32(m, b, ...)  m(32, b) UBX__FE_31(m, __VA_ARGS__)
+#define UBX__FE_33(m, b, ...)  m(33, b) UBX__FE_32(m, __VA_ARGS__)
+#define UBX__FE_34(m, b, ...)  m(34, b) UBX__FE_33(m, __VA_ARGS__)
+#define UBX__FE_35(m, b, ...)  m(35, b) UBX__FE_34(m, __VA_ARGS__)
+#define UBX__FE_36(m, b, ...)  m(36, b) UBX__FE_35(m, __VA_ARGS__)
+#define UBX__FE_37(m, b, ...)  m(37, b) UBX__FE_36(m, __VA_ARGS__)
+#define UBX__FE_38(m, b, ...)  m(38, b) UBX__FE_37(m, __VA_ARGS__)
+#define UBX__FE_39(m, b, ...)  m(39, b) UBX__FE_38(m, __VA_ARGS__)
+#define UBX__FE_40(m, b, ...)  m(40, b) UBX__FE_39(m, __VA_ARGS__)
+#define UBX__FE_41(m, b, ...)  m(41, b) UBX__FE_40(m, __VA_ARGS__)
+#define UBX__FE_42(m, b, ...)  m(42, b) UBX__FE_41(m, __VA_ARGS__)
+#define UBX__FE_43(m, b, ...)  m(43, b) UBX__FE_42(m, __VA_ARGS__)
+#define UBX__FE_44(m, b, ...)  m(44, b) UBX__FE_43(m, __VA_ARGS__)
+#define UBX__FE_45(m, b, ...)  m(45, b) UBX__FE_44(m, __VA_ARGS__)
+#define UBX__FE_46(m, b, ...)  m(46, b) UBX__FE_45(m, __VA_ARGS__)
+#define UBX__FE_47(m, b, ...)  m(47, b) UBX__FE_46(m, __VA_ARGS__)
+#define UBX__FE_48(m, b, ...)  m(48, b) UBX__FE_47(m, __VA_ARGS__)
+#define UBX__FE_49(m, b, ...)  m(49, b) UBX__FE_48(m, __VA_ARGS__)
+#define UBX__FE_50(m, b, ...)  m(50, b) UBX__FE_49(m, __VA_ARGS__)
+#define UBX__FE_51(m, b, ...)  m(51, b) UBX__FE_50(m, __VA_ARGS__)
+#define UBX__FE_52(m, b, ...)  m(52, b) UBX__FE_51(m, __VA_ARGS__)
+#define UBX__FE_53(m, b, ...)  m(53, b) UBX__FE_52(m, __VA_ARGS__)
+#define UBX__FE_54(m, b, ...)  m(54, b) UBX__FE_53(m, __VA_ARGS__)
+#define UBX__FE_55(m, b, ...)  m(55, b) UBX__FE_54(m, __VA_ARGS__)
+#define UBX__FE_56(m, b, ...)  m(56, b) UBX__FE_55(m, __VA_ARGS__)
+#define UBX__FE_57(m, b, ...)  m(57, b) UBX__FE_56(m, __VA_ARGS__)
+#define UBX__FE_58(m, b, ...)  m(58, b) UBX__FE_57(m, __VA_ARGS__)
+#define UBX__FE_59(m, b, ...)  m(59, b) UBX__FE_58(m, __VA_ARGS__)
+#define UBX__FE_60(m, b, ...)  m(60, b) UBX__FE_59(m, __VA_ARGS__)
+#define UBX__FE_61(m, b, ...)  m(61, b) UBX__FE_60(m, __VA_ARGS__)
+#define UBX__FE_62(m, b, ...)  m(62, b) UBX__FE_61(m, __VA_ARGS__)
+#define UBX__FE_63(m, b, ...)  m(63, b) UBX__FE_62(m, __VA_ARGS__)
+#define UBX__FE_64(m, b, ...)  m(64, b) UBX__FE_63(m, __VA_ARGS__)
+
+#endif /* INC_UBX_FRAME_H_ */
@@ -0,0 +1,82 @@
+/*
+ * uplink.h
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Tomas Oss
+ *
+ * Armado de las tramas que se mandan por LoRa.
+ * Todo en enteros: las coordenadas viajan tal cual en 1e-7 grados (gps_coord_t).
+ */
+
+#ifndef INC_UPLINK_H_
+#define INC_UPLINK_H_
+
+#include <stdint.h>
+#include "gps.h"
+#include "track.h"
+#include "geofence.h"
+
+// Tipos de trama (primer byte)
+#define UPLINK_MSG_FIX      0x01
+#define UPLINK_MSG_TRACK    0x02
+#define UPLINK_MSG_FENCE    0x03
+
+// UPLINK_MSG_FIX, little endian:
+// [0] tipo | [1..4] lat 1e-7 deg | [5..8] lon 1e-7 deg | [9..10] alt MSL en m (int16)
+// [11] satelites | [12] hdop x10 (satura en 255, 0 = desconocido) | [13..14] velocidad cm/s | [15] lock
+// [16..19] t (UPLINK_TIME) de la epoca del fix
+#define UPLINK_FIX_LEN      20
+
+// UPLINK_TIME (uint32): epoch UTC en s (timebase.h). Si todavia no hubo hora del GPS van los
+// segundos desde el arranque con el bit 31 en 1 (el epoch no llega a 2^31 hasta 2038).
+#define UPLINK_TIME_NO_UTC     0x80000000u
+
+// UPLINK_MSG_TRACK, little endian: puntos clave del recorrido simplificado (track.h)
+// [0] tipo | [1] cantidad N | [2..5] lat 1e-7 deg | [6..9] lon 1e-7 deg | [10..13] t (UPLINK_TIME)
+// y por cada uno de los N-1 puntos siguientes, respecto del anterior:
+// [dlat int16] [dlon int16] [dt s uint16]. Un punto que no entra en la diferencia abre otra trama.
+#define UPLINK_TRACK_HDR_LEN   14
+#define UPLINK_TRACK_PT_LEN    6
+#define UPLINK_TRACK_BATCH     8        // puntos por trama
+#define UPLINK_TRACK_MAX_LEN   (UPLINK_TRACK_HDR_LEN + (UPLINK_TRACK_BATCH - 1) * UPLINK_TRACK_PT_LEN)
+
+// UPLINK_MSG_FENCE, little endian: sale apenas se confirma, antes que cualquier otra trama
+// [0] tipo | [1] id del cerco | [2] evento (1 salida, 2 entrada) | [3] alarma (0/1)
+// [4..7] lat 1e-7 deg | [8..11] lon 1e-7 deg | [12..15] t (UPLINK_TIME)
+#define UPLINK_FENCE_LEN       16
+
+#define UPLINK_QUEUE_LEN       32       // puntos clave esperando salir (si se llena se pierde el mas viejo)
+
+/**
+ * Codifica un fix en buf. Devuelve la cantidad de bytes escritos (0 si no entra).
+ */
+uint8_t Uplink_EncodeFix(const GPS_t *fix, uint8_t *buf, uint8_t size);
+
+uint8_t Uplink_EncodeFence(const geofence_event_t *ev, uint8_t *buf, uint8_t size);
+
+/**
+ * Encola un punto clave del recorrido.
+ */
+void Uplink_QueuePoint(const track_point_t *p);
+
+uint8_t Uplink_Pending(void);
+
+/**
+ * HAL_GetTick del punto mas viejo en la cola (solo si Uplink_Pending() > 0).
+ */
+uint32_t Uplink_OldestMs(void);
+
+/**
+ * Codifica en buf los primeros puntos de la cola sin sacarlos; *count = cuantos entraron.
+ * Devuelve los bytes escritos (0 si la cola esta vacia o no entra ni el encabezado).
+ */
+uint8_t Uplink_EncodeTrack(uint8_t *buf, uint8_t size, uint8_t *count);
+
+/**
+ * Saca de la cola los puntos ya enviados (el count de Uplink_EncodeTrack).
+ */
+void Uplink_Release(uint8_t count);
+
+uint32_t Uplink_Dropped(void);
+
+#endif /* INC_UPLINK_H_ */
@@ -26,14 +26,59 @@ LoRa newLoRa(){
 	new_LoRa.power				   = POWER_20db;
 	new_LoRa.overCurrentProtection = 100       ;
 	new_LoRa.preamble			   = 8         ;
+	new_LoRa.spi_busy              = 0         ;
+	new_LoRa.spi_done              = NULL      ;
+	new_LoRa.tx_state              = LORA_TX_IDLE;
+	new_LoRa.tx_done               = NULL      ;
+	new_LoRa.tx_errors             = 0         ;
+	new_LoRa.rx_mode               = 0         ;
+	new_LoRa.rx_head               = 0         ;
+	new_LoRa.rx_tail               = 0         ;
+	new_LoRa.rx_pending            = 0         ;
+	new_LoRa.rx_packets            = 0         ;
+	new_LoRa.rx_overflows          = 0         ;
+	new_LoRa.rx_crc_errors         = 0         ;
+	new_LoRa.rx_errors             = 0         ;
+	new_LoRa.shadow_skips          = 0         ;
+	new_LoRa.init_cycles           = 0         ;
+	for (int i = 0; i < (int)sizeof(new_LoRa.shadow_ok); i++)
+		new_LoRa.shadow_ok[i] = 0;
 
 	return new_LoRa;
 }
 
+// registros de configuracion con copia: los que el chip no cambia solo (ni FIFO, ni flags, ni estado del paquete)
+static uint8_t LoRa_shadowed(uint8_t address){
+	switch (address) {
+	case RegOpMode:
+	case RegFrMsb: case RegFrMid: case RegFrLsb:
+	case RegPaConfig: case RegOcp: case RegLna:
+	case RegFiFoTxBaseAddr: case RegFiFoRxBaseAddr:
+	case RegModemConfig1: case RegModemConfig2: case RegSymbTimeoutL:
+	case RegPreambleMsb: case RegPreambleLsb: case RegPayloadLength:
+	case RegModemConfig3: case RegSyncWord:
+	case RegDioMapping1: case RegDioMapping2:
+		return 1;
+	}
+	return 0;
+}
+
+static void LoRa_shadowStore(LoRa* _LoRa, uint8_t address, uint8_t value){
+	if (!LoRa_shadowed(address))
+		return;
+	_LoRa->shadow[address] = value;
+	_LoRa->shadow_ok[address >> 3] |= (uint8_t)(1 << (address & 7));
+}
+
+static uint8_t LoRa_shadowValid(LoRa* _LoRa, uint8_t address){
+	return LoRa_shadowed(address) && (_LoRa->shadow_ok[address >> 3] & (1 << (address & 7)));
+}
+
 /* ----------------------------------------------------------------------------- *\
 		name        : LoRa_reset
 
-		description : reset module
+		description : reset module: 100 us pulse, then wait until RegVersion answers
+									(at most LORA_READY_TIMEOUT ms). The register copy is cleared.
 
 		arguments   :
 			LoRa* LoRa --> LoRa object handler
@@ -41,10 +86,24 @@ LoRa newLoRa(){
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_reset(LoRa* _LoRa){
+	uint32_t t0;
+
+	for (int i = 0; i < (int)sizeof(_LoRa->shadow_ok); i++)
+		_LoRa->shadow_ok[i] = 0;
+
+	// the 100 us pulse counts CPU cycles: make sure DWT runs even when called outside LoRa_init
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
 	HAL_GPIO_WritePin(_LoRa->reset_port, _LoRa->reset_pin, GPIO_PIN_RESET);
-	HAL_Delay(1);
+	t0 = DWT->CYCCNT;
+	while (DWT->CYCCNT - t0 < SystemCoreClock / 10000)
+		;
 	HAL_GPIO_WritePin(_LoRa->reset_port, _LoRa->reset_pin, GPIO_PIN_SET);
-	HAL_Delay(100);
+
+	t0 = HAL_GetTick();
+	while (LoRa_read(_LoRa, RegVersion) != 0x12 && (HAL_GetTick() - t0) < LORA_READY_TIMEOUT)
+		;
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -62,7 +121,7 @@ void LoRa_gotoMode(LoRa* _LoRa, int mode){
 	uint8_t    read;
 	uint8_t    data;
 
-	read = LoRa_read(_LoRa, RegOpMode);
+	read = LoRa_get(_LoRa, RegOpMode);
 	data = read;
 
 	if(mode == SLEEP_MODE){
@@ -82,8 +141,11 @@ void LoRa_gotoMode(LoRa* _LoRa, int mode){
 		_LoRa->current_mode = RXSINGLE_MODE;
 	}
 
-	LoRa_write(_LoRa, RegOpMode, data);
-	//HAL_Delay(10);
+	// TX y RX single vuelven solos a STDBY: la copia no sirve para saltear esas escrituras
+	if (mode == TRANSMIT_MODE || mode == RXSINGLE_MODE)
+		LoRa_write(_LoRa, RegOpMode, data);
+	else
+		LoRa_update(_LoRa, RegOpMode, 0xFF, data);
 }
 
 
@@ -103,6 +165,8 @@ void LoRa_gotoMode(LoRa* _LoRa, int mode){
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_readReg(LoRa* _LoRa, uint8_t* address, uint16_t r_length, uint8_t* output, uint16_t w_length){
+	while (_LoRa->spi_busy)		// una rafaga DMA tiene el bus (a lo sumo ~260 us)
+		;
 	HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_RESET);
 	HAL_SPI_Transmit(_LoRa->hSPIx, address, r_length, TRANSMIT_TIMEOUT);
 	while (HAL_SPI_GetState(_LoRa->hSPIx) != HAL_SPI_STATE_READY)
@@ -129,6 +193,8 @@ void LoRa_readReg(LoRa* _LoRa, uint8_t* address, uint16_t r_length, uint8_t* out
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_writeReg(LoRa* _LoRa, uint8_t* address, uint16_t r_length, uint8_t* values, uint16_t w_length){
+	while (_LoRa->spi_busy)
+		;
 	HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_RESET);
 	HAL_SPI_Transmit(_LoRa->hSPIx, address, r_length, TRANSMIT_TIMEOUT);
 	while (HAL_SPI_GetState(_LoRa->hSPIx) != HAL_SPI_STATE_READY)
@@ -151,18 +217,7 @@ void LoRa_writeReg(LoRa* _LoRa, uint8_t* address, uint16_t r_length, uint8_t* va
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_setLowDaraRateOptimization(LoRa* _LoRa, uint8_t value){
-	uint8_t	data;
-	uint8_t	read;
-
-	read = LoRa_read(_LoRa, RegModemConfig3);
-	
-	if(value)
-		data = read | 0x08;
-	else
-		data = read & 0xF7;
-
-	LoRa_write(_LoRa, RegModemConfig3, data);
-	HAL_Delay(10);
+	LoRa_update(_LoRa, RegModemConfig3, 0x08, value ? 0x08 : 0x00);
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -199,18 +254,15 @@ void LoRa_setFrequency(LoRa* _LoRa, int freq){
 
 	// write Msb:
 	data = F >> 16;
-	LoRa_write(_LoRa, RegFrMsb, data);
-	HAL_Delay(5);
+	LoRa_update(_LoRa, RegFrMsb, 0xFF, data);
 
 	// write Mid:
 	data = F >> 8;
-	LoRa_write(_LoRa, RegFrMid, data);
-	HAL_Delay(5);
+	LoRa_update(_LoRa, RegFrMid, 0xFF, data);
 
 	// write Lsb:
 	data = F >> 0;
-	LoRa_write(_LoRa, RegFrLsb, data);
-	HAL_Delay(5);
+	LoRa_update(_LoRa, RegFrLsb, 0xFF, data);
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -225,20 +277,12 @@ void LoRa_setFrequency(LoRa* _LoRa, int freq){
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_setSpreadingFactor(LoRa* _LoRa, int SF){
-	uint8_t	data;
-	uint8_t	read;
-
 	if(SF>12)
 		SF = 12;
 	if(SF<7)
 		SF = 7;
 
-	read = LoRa_read(_LoRa, RegModemConfig2);
-	HAL_Delay(10);
-
-	data = (SF << 4) + (read & 0x0F);
-	LoRa_write(_LoRa, RegModemConfig2, data);
-	HAL_Delay(10);
+	LoRa_update(_LoRa, RegModemConfig2, 0xF0, (uint8_t)(SF << 4));
 	
 	LoRa_setAutoLDO(_LoRa);
 }
@@ -255,8 +299,7 @@ void LoRa_setSpreadingFactor(LoRa* _LoRa, int SF){
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_setPower(LoRa* _LoRa, uint8_t power){
-	LoRa_write(_LoRa, RegPaConfig, power);
-	HAL_Delay(10);
+	LoRa_update(_LoRa, RegPaConfig, 0xFF, power);
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -284,8 +327,7 @@ void LoRa_setOCP(LoRa* _LoRa, uint8_t current){
 		OcpTrim = (current + 30)/10;
 
 	OcpTrim = OcpTrim + (1 << 5);
-	LoRa_write(_LoRa, RegOcp, OcpTrim);
-	HAL_Delay(10);
+	LoRa_update(_LoRa, RegOcp, 0xFF, OcpTrim);
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -299,13 +341,7 @@ void LoRa_setOCP(LoRa* _LoRa, uint8_t current){
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_setTOMsb_setCRCon(LoRa* _LoRa){
-	uint8_t read, data;
-
-	read = LoRa_read(_LoRa, RegModemConfig2);
-
-	data = read | 0x07;
-	LoRa_write(_LoRa, RegModemConfig2, data);\
-	HAL_Delay(10);
+	LoRa_update(_LoRa, RegModemConfig2, 0x07, 0x07);
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -319,8 +355,7 @@ void LoRa_setTOMsb_setCRCon(LoRa* _LoRa){
 		returns     : Nothing
 \* ----------------------------------------------------------------------------- */
 void LoRa_setSyncWord(LoRa* _LoRa, uint8_t syncword){
-	LoRa_write(_LoRa, RegSyncWord, syncword);
-	HAL_Delay(10);
+	LoRa_update(_LoRa, RegSyncWord, 0xFF, syncword);
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -340,7 +375,7 @@ uint8_t LoRa_read(LoRa* _LoRa, uint8_t address){
 
 	data_addr = address & 0x7F;
 	LoRa_readReg(_LoRa, &data_addr, 1, &read_data, 1);
-	//HAL_Delay(5);
+	LoRa_shadowStore(_LoRa, data_addr, read_data);
 
 	return read_data;
 }
@@ -364,7 +399,89 @@ void LoRa_write(LoRa* _LoRa, uint8_t address, uint8_t value){
 	addr = address | 0x80;
 	data = value;
 	LoRa_writeReg(_LoRa, &addr, 1, &data, 1);
-	//HAL_Delay(5);
+	LoRa_shadowStore(_LoRa, address & 0x7F, value);
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_get
+
+		description : read a register from the copy; the SPI is used only the first
+									time (or for registers without copy, e.g RegIrqFlags)
+
+		arguments   :
+			LoRa*   LoRa        --> LoRa object handler
+			uint8_t address     -->	address of the register e.g 0x1D
+
+		returns     : register value
+\* ----------------------------------------------------------------------------- */
+uint8_t LoRa_get(LoRa* _LoRa, uint8_t address){
+	address &= 0x7F;
+	if (LoRa_shadowValid(_LoRa, address))
+		return _LoRa->shadow[address];
+	return LoRa_read(_LoRa, address);
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_update
+
+		description : change the bits of mask in a register; it is written only if the
+									value changes (read-modify-write against the copy)
+
+		arguments   :
+			LoRa*   LoRa        --> LoRa object handler
+			uint8_t address     -->	address of the register e.g 0x1D
+			uint8_t mask        --> bits to change (0xFF: whole register)
+			uint8_t value       --> new value of those bits
+
+		returns     : 1 if it was written, 0 if it already had that value
+\* ----------------------------------------------------------------------------- */
+uint8_t LoRa_update(LoRa* _LoRa, uint8_t address, uint8_t mask, uint8_t value){
+	uint8_t read;
+	uint8_t data;
+
+	address &= 0x7F;
+	if (mask == 0xFF && !LoRa_shadowValid(_LoRa, address)) {
+		// registro entero sin copia: no hace falta leerlo antes
+		LoRa_write(_LoRa, address, value);
+		return 1;
+	}
+	read = LoRa_get(_LoRa, address);
+	data = (read & ~mask) | (value & mask);
+	if (data == read && LoRa_shadowValid(_LoRa, address)) {
+		_LoRa->shadow_skips++;
+		return 0;
+	}
+	LoRa_write(_LoRa, address, data);
+	return 1;
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_verify
+
+		description : read back 0x01..0x41 in one burst and compare it with the copy;
+									a register that does not match is dropped from the copy.
+
+		arguments   :
+			LoRa*   LoRa        --> LoRa object handler
+
+		returns     : LORA_OK or LORA_VERIFY_FAIL
+\* ----------------------------------------------------------------------------- */
+uint16_t LoRa_verify(LoRa* _LoRa){
+	uint8_t regs[LORA_SHADOW_SIZE];
+	uint8_t addr = RegOpMode;
+	uint16_t status = LORA_OK;
+
+	LoRa_readReg(_LoRa, &addr, 1, &regs[RegOpMode], LORA_SHADOW_SIZE - RegOpMode);
+	for (uint8_t a = RegOpMode; a < LORA_SHADOW_SIZE; a++) {
+		if (!LoRa_shadowValid(_LoRa, a) || regs[a] == _LoRa->shadow[a])
+			continue;
+		// el modo de TX / RX single pudo volver solo a STDBY
+		if (a == RegOpMode && (regs[a] & 0xF8) == (_LoRa->shadow[a] & 0xF8))
+			continue;
+		_LoRa->shadow_ok[a >> 3] &= (uint8_t)~(1 << (a & 7));
+		status = LORA_VERIFY_FAIL;
+	}
+	return status;
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -383,6 +500,9 @@ void LoRa_BurstWrite(LoRa* _LoRa, uint8_t address, uint8_t *value, uint8_t lengt
 	uint8_t addr;
 	addr = address | 0x80;
 
+	while (_LoRa->spi_busy)
+		;
+
 	//NSS = 1
 	HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_RESET);
 	
@@ -397,6 +517,151 @@ void LoRa_BurstWrite(LoRa* _LoRa, uint8_t address, uint8_t *value, uint8_t lengt
 	//HAL_Delay(5);
 	HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_SET);
 }
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_BurstWrite_DMA / LoRa_BurstRead_DMA
+
+		description : FIFO burst (payload load or read-out) by DMA1 ch3 (TX) / ch2 (RX).
+									The address byte goes out by polling (1 byte), then the DMA
+									moves the data and the CPU returns right away. NSS is released
+									in LoRa_SPI_CallBack, from HAL_SPI_TxCpltCallback (write) /
+									HAL_SPI_RxCpltCallback (read), and then done() is called.
+
+		arguments   :
+			LoRa*   LoRa        --> LoRa object handler
+			uint8_t address     -->	address of the register e.g RegFiFo
+			uint8_t *value      --> data buffer, it must stay valid until done()
+			uint8_t length      --> number of bytes (1..255)
+			LoRa_spiDone done   --> completion callback (ISR context), may be NULL
+
+		returns     : 1 if the transfer started, 0 if the bus is busy or HAL failed
+\* ----------------------------------------------------------------------------- */
+static uint8_t LoRa_burstStart(LoRa* _LoRa, uint8_t addr, LoRa_spiDone done){
+	if (_LoRa->spi_busy)
+		return 0;
+	_LoRa->spi_busy = 1;
+	_LoRa->spi_done = done;
+	_LoRa->spi_t0 = DWT->CYCCNT;
+
+	HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_RESET);
+	if (HAL_SPI_Transmit(_LoRa->hSPIx, &addr, 1, TRANSMIT_TIMEOUT) != HAL_OK) {
+		HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_SET);
+		_LoRa->spi_busy = 0;
+		return 0;
+	}
+	return 1;
+}
+
+static uint8_t LoRa_burstStarted(LoRa* _LoRa, HAL_StatusTypeDef st){
+	if (st != HAL_OK) {
+		HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_SET);
+		_LoRa->spi_done = NULL;
+		_LoRa->spi_busy = 0;
+		return 0;
+	}
+	_LoRa->spi_cpu_cycles = DWT->CYCCNT - _LoRa->spi_t0;
+	return 1;
+}
+
+uint8_t LoRa_BurstWrite_DMA(LoRa* _LoRa, uint8_t address, uint8_t *value, uint8_t length, LoRa_spiDone done){
+	if (length == 0 || !LoRa_burstStart(_LoRa, address | 0x80, done))
+		return 0;
+	return LoRa_burstStarted(_LoRa, HAL_SPI_Transmit_DMA(_LoRa->hSPIx, value, length));
+}
+
+uint8_t LoRa_BurstRead_DMA(LoRa* _LoRa, uint8_t address, uint8_t *output, uint8_t length, LoRa_spiDone done){
+	if (length == 0 || !LoRa_burstStart(_LoRa, address & 0x7F, done))
+		return 0;
+	// en master full-duplex el HAL usa los dos canales (TX manda el mismo buffer, el SX1278 lo ignora)
+	return LoRa_burstStarted(_LoRa, HAL_SPI_Receive_DMA(_LoRa->hSPIx, output, length));
+}
+
+uint8_t LoRa_spiBusy(LoRa* _LoRa){
+	return _LoRa->spi_busy;
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_SPI_CallBack
+
+		description : end of a DMA burst: release NSS and notify. Call it from
+									HAL_SPI_TxCpltCallback / HAL_SPI_RxCpltCallback (ok = 1)
+									and HAL_SPI_ErrorCallback (ok = 0) for this SPI.
+
+		arguments   :
+			LoRa*   LoRa        --> LoRa object handler
+			uint8_t ok          --> 0 on HAL error
+
+		returns     : Nothing
+\* ----------------------------------------------------------------------------- */
+static void LoRa_rxDone(LoRa* _LoRa, uint32_t t_ms);
+
+void LoRa_SPI_CallBack(LoRa* _LoRa, uint8_t ok){
+	LoRa_spiDone done = _LoRa->spi_done;
+
+	if (!_LoRa->spi_busy)
+		return;
+	HAL_GPIO_WritePin(_LoRa->CS_port, _LoRa->CS_pin, GPIO_PIN_SET);
+	_LoRa->spi_wall_cycles = DWT->CYCCNT - _LoRa->spi_t0;
+	_LoRa->spi_done = NULL;
+	_LoRa->spi_busy = 0;
+	if (done)
+		done(_LoRa, ok);
+	// un RxDone que llego con el bus ocupado (si arranco una TX, ella limpia los flags)
+	if (_LoRa->rx_pending && !_LoRa->spi_busy) {
+		_LoRa->rx_pending = 0;
+		if (_LoRa->rx_mode && _LoRa->tx_state == LORA_TX_IDLE)
+			LoRa_rxDone(_LoRa, _LoRa->rx_pending_t);
+	}
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_benchBurst
+
+		description : measure a FIFO burst of length bytes, blocking vs DMA, in DWT
+									cycles (SYSCLK). Leaves the modem in STDBY; it writes the FIFO.
+
+		arguments   :
+			LoRa*   LoRa        --> LoRa object handler
+			uint8_t length      --> burst size, e.g 64 or 255
+			LoRa_burstBench*    --> results
+
+		returns     : Nothing
+\* ----------------------------------------------------------------------------- */
+void LoRa_benchBurst(LoRa* _LoRa, uint8_t length, LoRa_burstBench* out){
+	static uint8_t buf[255];
+	uint8_t addr = RegFiFo & 0x7F;
+	uint32_t t0;
+
+	for (int i = 0; i < length; i++)
+		buf[i] = (uint8_t)i;
+	LoRa_gotoMode(_LoRa, STNBY_MODE);
+
+	LoRa_write(_LoRa, RegFiFoAddPtr, 0);
+	t0 = DWT->CYCCNT;
+	LoRa_BurstWrite(_LoRa, RegFiFo, buf, length);
+	out->write_blocking = DWT->CYCCNT - t0;
+
+	LoRa_write(_LoRa, RegFiFoAddPtr, 0);
+	if (LoRa_BurstWrite_DMA(_LoRa, RegFiFo, buf, length, NULL)) {
+		while (_LoRa->spi_busy)
+			;
+		out->write_dma_cpu = _LoRa->spi_cpu_cycles;
+		out->write_dma_wall = _LoRa->spi_wall_cycles;
+	}
+
+	LoRa_write(_LoRa, RegFiFoAddPtr, 0);
+	t0 = DWT->CYCCNT;
+	LoRa_readReg(_LoRa, &addr, 1, buf, length);
+	out->read_blocking = DWT->CYCCNT - t0;
+
+	LoRa_write(_LoRa, RegFiFoAddPtr, 0);
+	if (LoRa_BurstRead_DMA(_LoRa, RegFiFo, buf, length, NULL)) {
+		while (_LoRa->spi_busy)
+			;
+		out->read_dma_cpu = _LoRa->spi_cpu_cycles;
+		out->read_dma_wall = _LoRa->spi_wall_cycles;
+	}
+}
+
 /* ----------------------------------------------------------------------------- *\
 		name        : LoRa_isvalid
 
@@ -427,11 +692,13 @@ uint8_t LoRa_isvalid(LoRa* _LoRa){
 uint8_t LoRa_transmit(LoRa* _LoRa, uint8_t* data, uint8_t length, uint16_t timeout){
 	uint8_t read;
 
+	if (_LoRa->tx_state != LORA_TX_IDLE)
+		return 0;
 	int mode = _LoRa->current_mode;
 	LoRa_gotoMode(_LoRa, STNBY_MODE);
-	read = LoRa_read(_LoRa, RegFiFoTxBaseAddr);
+	read = LoRa_get(_LoRa, RegFiFoTxBaseAddr);
 	LoRa_write(_LoRa, RegFiFoAddPtr, read);
-	LoRa_write(_LoRa, RegPayloadLength, length);
+	LoRa_update(_LoRa, RegPayloadLength, 0xFF, length);
 	LoRa_BurstWrite(_LoRa, RegFiFo, data, length);
 	LoRa_gotoMode(_LoRa, TRANSMIT_MODE);
 	while(1){
@@ -451,6 +718,143 @@ uint8_t LoRa_transmit(LoRa* _LoRa, uint8_t* data, uint8_t length, uint16_t timeo
 	}
 }
 
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_transmit_IT
+
+		description : Transmit data without blocking. The FIFO is loaded by DMA
+									(LoRa_BurstWrite_DMA), DIO0 is mapped to TxDone for the
+									transmission and the end is handled in LoRa_DIO0_CallBack
+									(EXTI). The timeout is enforced from SysTick
+									(LoRa_SysTick_CallBack), which fires the DIO0 EXTI line by
+									software, so every completion runs in the same ISR.
+									While it is busy only the ISRs touch the radio.
+
+		arguments   :
+			LoRa*    LoRa     --> LoRa object handler
+			uint8_t  data			--> A pointer to the data, it must stay valid until done()
+			uint8_t	 length   --> Size of your data in Bytes
+			uint16_t timeOut	--> Timeout in milliseconds (load + time on air)
+			LoRa_txDone done  --> result callback (ISR context), may be NULL
+
+		returns     : 1 if the transmission started, 0 if busy or HAL failed
+\* ----------------------------------------------------------------------------- */
+static void LoRa_txFinish(LoRa* _LoRa, uint8_t ok){
+	LoRa_txDone done = _LoRa->tx_done;
+
+	LoRa_write(_LoRa, RegIrqFlags, 0xFF);
+	LoRa_update(_LoRa, RegDioMapping1, 0xFF, _LoRa->tx_dio_map);
+	LoRa_gotoMode(_LoRa, _LoRa->tx_mode);
+	_LoRa->tx_air_ms = HAL_GetTick() - _LoRa->tx_t0;
+	if (!ok)
+		_LoRa->tx_errors++;
+	_LoRa->tx_done = NULL;
+	_LoRa->tx_state = LORA_TX_IDLE;
+	if (done)
+		done(_LoRa, ok);
+}
+
+// fin de la carga del FIFO (ISR del DMA): arranca la transmision
+static void LoRa_txLoaded(LoRa* _LoRa, uint8_t ok){
+	if (_LoRa->tx_state != LORA_TX_LOADING)
+		return;
+	if (!ok) {
+		LoRa_txFinish(_LoRa, 0);
+		return;
+	}
+	_LoRa->tx_state = LORA_TX_ON_AIR;
+	LoRa_gotoMode(_LoRa, TRANSMIT_MODE);
+}
+
+uint8_t LoRa_transmit_IT(LoRa* _LoRa, uint8_t* data, uint8_t length, uint16_t timeout, LoRa_txDone done){
+	uint8_t read;
+
+	if (_LoRa->tx_state != LORA_TX_IDLE || length == 0 || timeout == 0)
+		return 0;
+	_LoRa->tx_timeout = timeout;
+	_LoRa->tx_t0 = HAL_GetTick();
+	// desde aca la EXTI de DIO0 ya no arranca lecturas de RX; si habia una en curso, se espera otra vuelta
+	_LoRa->tx_state = LORA_TX_LOADING;
+	if (_LoRa->spi_busy) {
+		_LoRa->tx_state = LORA_TX_IDLE;
+		return 0;
+	}
+	_LoRa->rx_pending = 0;		// la TX limpia los flags de RX
+	_LoRa->tx_mode = _LoRa->current_mode;
+	_LoRa->tx_done = done;
+
+	LoRa_gotoMode(_LoRa, STNBY_MODE);
+	read = LoRa_get(_LoRa, RegFiFoTxBaseAddr);
+	LoRa_write(_LoRa, RegFiFoAddPtr, read);
+	LoRa_update(_LoRa, RegPayloadLength, 0xFF, length);
+	// DIO0 = TxDone (mapping 01) mientras dure la transmision
+	_LoRa->tx_dio_map = LoRa_get(_LoRa, RegDioMapping1);
+	LoRa_update(_LoRa, RegDioMapping1, 0xC0, 0x40);
+	LoRa_write(_LoRa, RegIrqFlags, 0xFF);
+
+	if (!LoRa_BurstWrite_DMA(_LoRa, RegFiFo, data, length, LoRa_txLoaded)) {
+		_LoRa->tx_done = NULL;
+		LoRa_update(_LoRa, RegDioMapping1, 0xFF, _LoRa->tx_dio_map);
+		LoRa_gotoMode(_LoRa, _LoRa->tx_mode);
+		_LoRa->tx_state = LORA_TX_IDLE;
+		return 0;
+	}
+	return 1;
+}
+
+uint8_t LoRa_txBusy(LoRa* _LoRa){
+	return _LoRa->tx_state != LORA_TX_IDLE;
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_DIO0_CallBack
+
+		description : DIO0 interrupt: end of a LoRa_transmit_IT (TxDone or timeout)
+									or, with the receive engine on, RxDone.
+									Call it from HAL_GPIO_EXTI_Callback for the DIO0 pin.
+
+		arguments   :
+			LoRa*    LoRa     --> LoRa object handler
+
+		returns     : Nothing
+\* ----------------------------------------------------------------------------- */
+void LoRa_DIO0_CallBack(LoRa* _LoRa){
+	uint32_t now = HAL_GetTick();
+	uint8_t state = _LoRa->tx_state;
+	uint8_t expired = (now - _LoRa->tx_t0) >= _LoRa->tx_timeout;
+
+	if (state == LORA_TX_IDLE) {
+		if (_LoRa->rx_mode)
+			LoRa_rxDone(_LoRa, now);
+	} else if (state == LORA_TX_ON_AIR) {
+		if (LoRa_read(_LoRa, RegIrqFlags) & 0x08)
+			LoRa_txFinish(_LoRa, 1);
+		else if (expired)
+			LoRa_txFinish(_LoRa, 0);
+	} else if (state == LORA_TX_LOADING && expired && _LoRa->spi_busy) {
+		// el DMA de la carga no termino: se corta y la rafaga se cierra con error
+		HAL_SPI_Abort(_LoRa->hSPIx);
+		LoRa_SPI_CallBack(_LoRa, 0);
+	}
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_SysTick_CallBack
+
+		description : timeout of LoRa_transmit_IT. Call it every tick from
+									SysTick_Handler; when it expires it triggers the DIO0 EXTI
+									line by software (EXTI->SWIER) and LoRa_DIO0_CallBack ends
+									the transmission.
+
+		arguments   :
+			LoRa*    LoRa     --> LoRa object handler
+
+		returns     : Nothing
+\* ----------------------------------------------------------------------------- */
+void LoRa_SysTick_CallBack(LoRa* _LoRa){
+	if (_LoRa->tx_state != LORA_TX_IDLE && (HAL_GetTick() - _LoRa->tx_t0) >= _LoRa->tx_timeout)
+		EXTI->SWIER = _LoRa->DIO0_pin;
+}
+
 /* ----------------------------------------------------------------------------- *\
 		name        : LoRa_startReceiving
 
@@ -465,10 +869,64 @@ void LoRa_startReceiving(LoRa* _LoRa){
 	LoRa_gotoMode(_LoRa, RXCONTIN_MODE);
 }
 
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_receivePacket
+
+		description : Read the last received packet, if RxDone is set, without
+									leaving the current mode (RX continuous keeps receiving).
+									Status registers are read in two bursts (0x10..0x13 and
+									0x19..0x1A) and the payload in one burst straight into data.
+
+		arguments   :
+			LoRa*    LoRa     --> LoRa object handler
+			uint8_t  data			--> A pointer to the array that you want to write bytes in it
+			uint8_t	 size     --> Size of data; a longer packet is truncated
+			LoRa_packet* pkt  --> Packet descriptor (length, RSSI, SNR, CRC, timestamp)
+
+		returns     : 1 if a packet was read, 0 if there was no RxDone
+\* ----------------------------------------------------------------------------- */
+// estado del paquete (RxDone, largo, CRC, RSSI/SNR) en dos rafagas; deja el puntero del FIFO en el paquete
+static uint8_t LoRa_rxHeader(LoRa* _LoRa, uint8_t size, uint32_t t_ms, LoRa_packet* pkt){
+	uint8_t addr;
+	uint8_t st[4];		// RegFiFoRxCurrentAddr, RegIrqFlagsMask, RegIrqFlags, RegRxNbBytes
+	uint8_t q[2];		// RegPktSnrValue, RegPktRssiValue
+
+	addr = RegFiFoRxCurrentAddr;
+	LoRa_readReg(_LoRa, &addr, 1, st, sizeof(st));
+	if ((st[2] & 0x40) == 0)
+		return 0;
+	LoRa_write(_LoRa, RegIrqFlags, 0xFF);
+
+	pkt->t_ms = t_ms;
+	pkt->rx_bytes = st[3];
+	pkt->length = (st[3] < size) ? st[3] : size;
+	pkt->crc_ok = (st[2] & 0x20) == 0;
+
+	addr = RegPktSnrValue;
+	LoRa_readReg(_LoRa, &addr, 1, q, sizeof(q));
+	pkt->snr_q2 = (int8_t)q[0];
+	pkt->rssi = -164 + q[1];
+	if (pkt->snr_q2 < 0)
+		pkt->rssi += pkt->snr_q2 / 4;
+
+	LoRa_write(_LoRa, RegFiFoAddPtr, st[0]);
+	return 1;
+}
+
+uint8_t LoRa_receivePacket(LoRa* _LoRa, uint8_t* data, uint8_t size, LoRa_packet* pkt){
+	uint8_t addr = RegFiFo;
+
+	if (!LoRa_rxHeader(_LoRa, size, HAL_GetTick(), pkt))
+		return 0;
+	if (pkt->length)
+		LoRa_readReg(_LoRa, &addr, 1, data, pkt->length);
+	return 1;
+}
+
 /* ----------------------------------------------------------------------------- *\
 		name        : LoRa_Receive
 
-		description : Read received data from module
+		description : Read received data from module (see LoRa_receivePacket)
 
 		arguments   :
 			LoRa*    LoRa     --> LoRa object handler
@@ -478,26 +936,122 @@ void LoRa_startReceiving(LoRa* _LoRa){
 		returns     : The number of bytes received
 \* ----------------------------------------------------------------------------- */
 uint8_t LoRa_receive(LoRa* _LoRa, uint8_t* data, uint8_t length){
-	uint8_t read;
-	uint8_t number_of_bytes;
-	uint8_t min = 0;
+	LoRa_packet pkt;
 
-	for(int i=0; i<length; i++)
-		data[i]=0;
+	if (!LoRa_receivePacket(_LoRa, data, length, &pkt))
+		return 0;
+	return pkt.length;
+}
 
-	LoRa_gotoMode(_LoRa, STNBY_MODE);
-	read = LoRa_read(_LoRa, RegIrqFlags);
-	if((read & 0x40) != 0){
-		LoRa_write(_LoRa, RegIrqFlags, 0xFF);
-		number_of_bytes = LoRa_read(_LoRa, RegRxNbBytes);
-		read = LoRa_read(_LoRa, RegFiFoRxCurrentAddr);
-		LoRa_write(_LoRa, RegFiFoAddPtr, read);
-		min = length >= number_of_bytes ? number_of_bytes : length;
-		for(int i=0; i<min; i++)
-			data[i] = LoRa_read(_LoRa, RegFiFo);
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_startReceive_IT / LoRa_stopReceive_IT
+
+		description : RxDone-driven receive. On each DIO0 interrupt the packet
+									header is read and the payload is moved by DMA into the
+									next free slot of a fixed pool (LORA_RX_SLOTS of
+									LORA_RX_MAX_LEN bytes); the slot is published to the ring
+									when the DMA ends. Packets with a CRC error or with the ring
+									full are dropped and counted. RXCONTIN_MODE keeps listening;
+									RXSINGLE_MODE is re-armed after each packet and, through
+									LoRa_transmit_IT, after each uplink (ACK window).
+									While it is on, main only uses LoRa_transmit_IT and the ring.
+
+		arguments   :
+			LoRa*    LoRa     --> LoRa object handler
+			int      mode     --> RXCONTIN_MODE or RXSINGLE_MODE
+
+		returns     : Nothing
+\* ----------------------------------------------------------------------------- */
+void LoRa_startReceive_IT(LoRa* _LoRa, int mode){
+	if (_LoRa->tx_state != LORA_TX_IDLE)
+		return;
+	_LoRa->rx_mode = 0;
+	while (_LoRa->spi_busy)
+		;
+	LoRa_update(_LoRa, RegDioMapping1, 0xC0, 0x00);		// DIO0 = RxDone
+	LoRa_write(_LoRa, RegIrqFlags, 0xFF);
+	LoRa_gotoMode(_LoRa, mode);
+	_LoRa->rx_mode = mode;
+}
+
+void LoRa_stopReceive_IT(LoRa* _LoRa){
+	_LoRa->rx_mode = 0;
+	while (_LoRa->spi_busy)
+		;
+	if (_LoRa->tx_state == LORA_TX_IDLE)
+		LoRa_gotoMode(_LoRa, STNBY_MODE);
+}
+
+// fin del DMA del payload (ISR del DMA): publica el slot
+static void LoRa_rxLoaded(LoRa* _LoRa, uint8_t ok){
+	if (ok) {
+		__DMB();                        // el slot tiene que estar escrito antes de publicarlo
+		_LoRa->rx_head++;
+		_LoRa->rx_packets++;
+	} else {
+		_LoRa->rx_errors++;
 	}
-	LoRa_gotoMode(_LoRa, RXCONTIN_MODE);
-    return min;
+	// si arranco una TX, ella vuelve al modo de RX al terminar
+	if (_LoRa->rx_mode == RXSINGLE_MODE && _LoRa->tx_state == LORA_TX_IDLE)
+		LoRa_gotoMode(_LoRa, RXSINGLE_MODE);
+}
+
+static void LoRa_rxDone(LoRa* _LoRa, uint32_t t_ms){
+	LoRa_rxSlot* slot = &_LoRa->rx_slots[_LoRa->rx_head % LORA_RX_SLOTS];
+	LoRa_packet pkt;
+
+	// con una rafaga DMA en curso no se puede esperar aca (misma prioridad que el DMA):
+	// DIO0 queda arriba hasta limpiar los flags, asi que lo atiende LoRa_SPI_CallBack
+	if (_LoRa->spi_busy) {
+		_LoRa->rx_pending = 1;
+		_LoRa->rx_pending_t = t_ms;
+		return;
+	}
+	// el encabezado va a una copia: con el anillo lleno el slot es el que main esta leyendo
+	if (!LoRa_rxHeader(_LoRa, LORA_RX_MAX_LEN, t_ms, &pkt))
+		return;
+
+	if (!pkt.crc_ok) {
+		_LoRa->rx_crc_errors++;
+	} else if ((uint8_t)(_LoRa->rx_head - _LoRa->rx_tail) >= LORA_RX_SLOTS) {
+		_LoRa->rx_overflows++;
+	} else if (pkt.length == 0) {
+		slot->pkt = pkt;
+		LoRa_rxLoaded(_LoRa, 1);
+		return;
+	} else {
+		slot->pkt = pkt;
+		if (LoRa_BurstRead_DMA(_LoRa, RegFiFo, slot->data, pkt.length, LoRa_rxLoaded))
+			return;
+		_LoRa->rx_errors++;
+	}
+	if (_LoRa->rx_mode == RXSINGLE_MODE)
+		LoRa_gotoMode(_LoRa, RXSINGLE_MODE);
+}
+
+/* ----------------------------------------------------------------------------- *\
+		name        : LoRa_rxPeek / LoRa_rxRelease
+
+		description : main side of the receive ring: oldest packet (NULL if empty),
+									then give its slot back to the ISR.
+
+		arguments   :
+			LoRa*    LoRa     --> LoRa object handler
+
+		returns     : the slot (valid until LoRa_rxRelease) / Nothing
+\* ----------------------------------------------------------------------------- */
+const LoRa_rxSlot* LoRa_rxPeek(LoRa* _LoRa){
+	if (_LoRa->rx_tail == _LoRa->rx_head)
+		return NULL;
+	__DMB();
+	return &_LoRa->rx_slots[_LoRa->rx_tail % LORA_RX_SLOTS];
+}
+
+void LoRa_rxRelease(LoRa* _LoRa){
+	if (_LoRa->rx_tail == _LoRa->rx_head)
+		return;
+	__DMB();                            // termine de leer el slot antes de liberarlo
+	_LoRa->rx_tail++;
 }
 
 /* ----------------------------------------------------------------------------- *\
@@ -516,52 +1070,67 @@ int LoRa_getRSSI(LoRa* _LoRa){
 	return -164 + read;
 }
 
+// escribe y relee hasta que quede, en lugar de una espera fija
+static uint8_t LoRa_writeVerify(LoRa* _LoRa, uint8_t address, uint8_t value){
+	for (int i = 0; i < LORA_VERIFY_TRIES; i++) {
+		LoRa_write(_LoRa, address, value);
+		if (LoRa_read(_LoRa, address) == value)
+			return 1;
+	}
+	return 0;
+}
+
 /* ----------------------------------------------------------------------------- *\
 		name        : LoRa_init
 
-		description : initialize and set the right setting according to LoRa sruct vars
+		description : initialize and set the right setting according to LoRa sruct vars.
+									No fixed delays: the reset waits for RegVersion, the OpMode
+									write is read back and the whole configuration is verified
+									at the end (LoRa_verify). The time it took is left in
+									init_cycles (DWT, SYSCLK).
 
 		arguments   :
 			LoRa* LoRa        --> LoRa object handler
 
-		returns     : Nothing
+		returns     : LORA_OK, LORA_NOT_FOUND or LORA_VERIFY_FAIL
 \* ----------------------------------------------------------------------------- */
 uint16_t LoRa_init(LoRa* l)
 {
     uint8_t read, data;
+    uint16_t status;
+    uint32_t t0;
 
     if (!LoRa_isvalid(l)) return LORA_UNAVAILABLE;
 
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    t0 = DWT->CYCCNT;
+
     // 0) Asegurar NSS idle en HIGH
     HAL_GPIO_WritePin(l->CS_port, l->CS_pin, GPIO_PIN_SET);
-    HAL_Delay(2);
 
-    // 1) Reset a estado conocido (datasheet: 100us low, esperar 5ms; acá tu reset es más conservador)
+    // 1) Reset a estado conocido (pulso de 100us; LoRa_reset espera a que RegVersion responda)
     LoRa_reset(l);
 
-    // 2) Check temprano de RegVersion (0x42 debe ser 0x12)
-    for (int i = 0; i < 3; i++) {
-        read = LoRa_read(l, RegVersion);
-        if (read == 0x12) break;
-        HAL_Delay(10);
-        if (i == 2) return LORA_NOT_FOUND;
-    }
+    // 2) Check de RegVersion (0x42 debe ser 0x12)
+    read = LoRa_read(l, RegVersion);
+    if (read != 0x12) return LORA_NOT_FOUND;
 
     // 3) Entrar en SLEEP en LoRa + LowFrequency (433MHz)
     // RegOpMode bits: [7]=LoRa, [3]=LowFrequencyModeOn, [2:0]=Mode
+    // LongRangeMode solo cambia en SLEEP: si no quedo en la primera escritura, queda en la segunda
     data = 0;
     data |= 0x80;   // LongRangeMode = 1 (LoRa)
     data |= 0x08;   // LowFrequencyModeOn = 1 (LF path)
     data |= 0x00;   // Mode = 000 (SLEEP)
-    LoRa_write(l, RegOpMode, data);
-    HAL_Delay(5);
+    if (!LoRa_writeVerify(l, RegOpMode, data)) return LORA_VERIFY_FAIL;
 
-    // 4) Configuración básica (en SLEEP/STDBY)
+    // 4) Configuración básica (en SLEEP/STDBY); cada registro sale una sola vez
     LoRa_setFrequency(l, l->frequency);
     LoRa_setPower(l, l->power);
     LoRa_setOCP(l, l->overCurrentProtection);
 
-    LoRa_write(l, RegLna, 0x23);
+    LoRa_update(l, RegLna, 0xFF, 0x23);
 
     // SF + CRC + timeout
     // Recomendado: limpiar flags antes
@@ -569,36 +1138,35 @@ uint16_t LoRa_init(LoRa* l)
 
     LoRa_setSpreadingFactor(l, l->spredingFactor);
 
-    // CRC on + SymbTimeoutMSB=3 (si querés)
-    read = LoRa_read(l, RegModemConfig2);
-    read = (read & 0xF8) | 0x07;   // limpia bits 2:0 y los fuerza a 111 (incluye CRC ON)
-    LoRa_write(l, RegModemConfig2, read);
+    // CRC on + SymbTimeoutMSB=3 (bits 2:0 = 111)
+    LoRa_update(l, RegModemConfig2, 0x07, 0x07);
 
-    LoRa_write(l, RegSymbTimeoutL, 0xFF);
+    LoRa_update(l, RegSymbTimeoutL, 0xFF, 0xFF);
 
     // BW + CodingRate + Explicit header
     data = (l->bandWidth << 4) | (l->crcRate << 1) | 0x00;
-    LoRa_write(l, RegModemConfig1, data);
+    LoRa_update(l, RegModemConfig1, 0xFF, data);
 
     LoRa_setAutoLDO(l);
 
     // Preamble
-    LoRa_write(l, RegPreambleMsb, (uint8_t)(l->preamble >> 8));
-    LoRa_write(l, RegPreambleLsb, (uint8_t)(l->preamble >> 0));
+    LoRa_update(l, RegPreambleMsb, 0xFF, (uint8_t)(l->preamble >> 8));
+    LoRa_update(l, RegPreambleLsb, 0xFF, (uint8_t)(l->preamble >> 0));
 
     // SyncWord explícito (opcional, pero recomendable)
     // 0x12 P2P / privado; 0x34 reservado LoRaWAN (según datasheet)
-    LoRa_write(l, RegSyncWord, 0x12);
+    LoRa_update(l, RegSyncWord, 0xFF, 0x12);
 
     // 5) DIO0 = RxDone (mapping 00), sin romper el resto
-    read = LoRa_read(l, RegDioMapping1);
-    read = (read & 0x3F) | (0x00 << 6);  // DIO0=00
-    LoRa_write(l, RegDioMapping1, read);
+    LoRa_update(l, RegDioMapping1, 0xC0, 0x00 << 6);
 
     // 6) Ir a STDBY al final
     LoRa_gotoMode(l, STNBY_MODE);
     l->current_mode = STNBY_MODE;
 
-    return LORA_OK;
-}
+    // 7) Releer toda la configuracion contra la copia
+    status = LoRa_verify(l);
+    l->init_cycles = DWT->CYCCNT - t0;
 
+    return status;
+}
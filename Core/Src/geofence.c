@@ -0,0 +1,165 @@
+/*
+ * geofence.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "geofence.h"
+
+typedef enum {
+	FENCE_UNKNOWN = 0,       // todavia sin confirmar (arranque o cercos recien cargados)
+	FENCE_OUTSIDE,
+	FENCE_INSIDE
+} fence_side_t;
+
+typedef struct {
+	gps_coord_t lat_min, lat_max;
+	gps_coord_t lon_min, lon_max;
+	uint8_t side;            // fence_side_t confirmado
+	uint8_t pending;         // lado que se esta confirmando
+	uint8_t count;           // fixes seguidos en pending
+	bool ev_pending;
+	geofence_event_t ev;
+} fence_state_t;
+
+static geofence_poly_t fence_polys[GEOFENCE_MAX_POLYS];
+static fence_state_t fence_state[GEOFENCE_MAX_POLYS];
+static uint8_t fence_count;
+static geofence_stats_t fence_stats;
+
+void Geofence_Init(void){
+	fence_count = 0;
+	memset(fence_state, 0, sizeof(fence_state));
+	memset(&fence_stats, 0, sizeof(fence_stats));
+}
+
+geofence_status_t Geofence_Load(const geofence_poly_t *polys, uint8_t count){
+	fence_state_t st[GEOFENCE_MAX_POLYS];
+
+	if (count > GEOFENCE_MAX_POLYS || (count && !polys)) return GEOFENCE_ERR_COUNT;
+
+	memset(st, 0, sizeof(st));
+	for (uint8_t i = 0; i < count; i++) {
+		const geofence_poly_t *p = &polys[i];
+		if (p->count < 3 || p->count > GEOFENCE_MAX_VERTS) return GEOFENCE_ERR_POLY;
+
+		st[i].lat_min = st[i].lat_max = p->v[0].lat;
+		st[i].lon_min = st[i].lon_max = p->v[0].lon;
+		for (uint8_t k = 1; k < p->count; k++) {
+			if (p->v[k].lat < st[i].lat_min) st[i].lat_min = p->v[k].lat;
+			if (p->v[k].lat > st[i].lat_max) st[i].lat_max = p->v[k].lat;
+			if (p->v[k].lon < st[i].lon_min) st[i].lon_min = p->v[k].lon;
+			if (p->v[k].lon > st[i].lon_max) st[i].lon_max = p->v[k].lon;
+		}
+		if ((int64_t)st[i].lat_max - st[i].lat_min > GEOFENCE_SPAN_MAX ||
+		    (int64_t)st[i].lon_max - st[i].lon_min > GEOFENCE_SPAN_MAX) return GEOFENCE_ERR_POLY;
+	}
+
+	memcpy(fence_polys, polys, count * sizeof(geofence_poly_t));
+	memcpy(fence_state, st, sizeof(st));
+	fence_count = count;
+	return GEOFENCE_OK;
+}
+
+// Numero de cruces: rayo hacia el este desde el punto, cuenta las aristas que lo cortan.
+// x < xi + (y - yi) (xj - xi) / (yj - yi) se compara multiplicado por (yj - yi), con su signo.
+// El punto ya paso la bbox, asi que todas las diferencias son menores que GEOFENCE_SPAN_MAX.
+static bool fence_inside(const geofence_poly_t *p, gps_coord_t lat, gps_coord_t lon){
+	bool in = false;
+	uint8_t j = p->count - 1;
+
+	for (uint8_t i = 0; i < p->count; j = i++) {
+		const geofence_vertex_t *a = &p->v[i], *b = &p->v[j];
+		if ((a->lat > lat) == (b->lat > lat)) continue;
+
+		int64_t dy = (int64_t)b->lat - a->lat;
+		int64_t lhs = ((int64_t)lon - a->lon) * dy;
+		int64_t rhs = ((int64_t)lat - a->lat) * ((int64_t)b->lon - a->lon);
+		if ((dy > 0) ? (lhs < rhs) : (lhs > rhs)) in = !in;
+	}
+	return in;
+}
+
+static bool fence_confirm(uint8_t i, uint8_t side, gps_coord_t lat, gps_coord_t lon, uint32_t t_ms){
+	fence_state_t *s = &fence_state[i];
+	const geofence_poly_t *p = &fence_polys[i];
+	uint8_t prev = s->side;
+
+	s->side = side;
+	bool alarm = (p->kind == GEOFENCE_KEEP_IN) ? (side == FENCE_OUTSIDE) : (side == FENCE_INSIDE);
+	// al arrancar solo se avisa si ya esta en alarma
+	if (prev == FENCE_UNKNOWN && !alarm) return false;
+
+	s->ev.id = p->id;
+	s->ev.type = (side == FENCE_INSIDE) ? GEOFENCE_EV_ENTER : GEOFENCE_EV_EXIT;
+	s->ev.alarm = alarm;
+	s->ev.lat = lat;
+	s->ev.lon = lon;
+	s->ev.t_ms = t_ms;
+	s->ev_pending = true;
+	fence_stats.events++;
+	if (alarm) fence_stats.alarms++;
+	return true;
+}
+
+bool Geofence_Check(gps_coord_t lat, gps_coord_t lon, uint32_t t_ms){
+	uint32_t t0 = DWT->CYCCNT;
+	bool changed = false;
+
+	fence_stats.checks++;
+	for (uint8_t i = 0; i < fence_count; i++) {
+		fence_state_t *s = &fence_state[i];
+		uint8_t side = FENCE_OUTSIDE;
+
+		if (lat >= s->lat_min && lat <= s->lat_max && lon >= s->lon_min && lon <= s->lon_max) {
+			fence_stats.bbox_hits++;
+			if (fence_inside(&fence_polys[i], lat, lon)) side = FENCE_INSIDE;
+		}
+
+		if (side == s->side) {
+			s->count = 0;
+			continue;
+		}
+		if (side != s->pending) {
+			s->pending = side;
+			s->count = 0;
+		}
+		if (++s->count >= GEOFENCE_HYST_FIXES) {
+			s->count = 0;
+			changed |= fence_confirm(i, side, lat, lon, t_ms);
+		}
+	}
+
+	uint32_t dt = DWT->CYCCNT - t0;
+	if (dt > fence_stats.max_cycles) fence_stats.max_cycles = dt;
+	return changed;
+}
+
+bool Geofence_PendingEvent(geofence_event_t *ev){
+	int8_t best = -1;
+
+	for (uint8_t i = 0; i < fence_count; i++) {
+		if (!fence_state[i].ev_pending) continue;
+		if (best < 0 || (fence_state[i].ev.alarm && !fence_state[best].ev.alarm)) best = (int8_t)i;
+	}
+	if (best < 0) return false;
+	*ev = fence_state[best].ev;
+	return true;
+}
+
+void Geofence_EventSent(const geofence_event_t *ev){
+	for (uint8_t i = 0; i < fence_count; i++) {
+		fence_state_t *s = &fence_state[i];
+		// si volvio a cambiar mientras se transmitia, queda el evento nuevo
+		if (s->ev_pending && s->ev.id == ev->id && s->ev.t_ms == ev->t_ms && s->ev.type == ev->type) {
+			s->ev_pending = false;
+		}
+	}
+}
+
+geofence_stats_t Geofence_GetStats(void){
+	return fence_stats;
+}
@@ -5,16 +5,97 @@
  */
 
 
-#include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
 #include <usart.h>
 #include "gps.h"
 #include "ubx.h"
+#include "gps_filter.h"
 
 
-uint8_t rx_data = 0;
-uint8_t rx_buffer[GPSBUFSIZE];
-uint8_t rx_index = 0;
+uint8_t rx_dma_buffer[GPS_DMA_RX_SIZE]; // lo escribe el DMA en modo circular
+static uint16_t rx_dma_pos = 0;         // hasta donde ya consumi del buffer DMA
+static GPS_Stats_t gps_stats;
+
+// Cola SPSC de sentencias: la ISR (productor) arma sentencias completas en los slots
+// y GPS_Process() (consumidor, contexto main) las parsea.
+// head solo lo escribe la ISR, tail solo el main; los dos corren libres (uint8_t).
+#define GPS_SLOT_NMEA  0
+#define GPS_SLOT_UBX   1
+
+typedef struct {
+    uint8_t type;               // GPS_SLOT_NMEA / GPS_SLOT_UBX
+    uint8_t msg;                // NMEA: indice en gps_nmea_types (resuelto en la ISR)
+    uint8_t len;
+    uint32_t tick;              // HAL_GetTick del primer byte (ver gps_rx_start_tick)
+    char    data[GPSBUFSIZE];   // NMEA: sentencia terminada en '\0', sin CR/LF
+                                // UBX: class, id, payload (checksum ya verificado)
+} gps_slot_t;
+
+static gps_slot_t gps_ring[GPS_SENTENCE_SLOTS];
+static volatile uint8_t gps_ring_head = 0;
+static volatile uint8_t gps_ring_tail = 0;
+
+// Tipos NMEA que se parsean, por formatter de 3 letras (el talker GP/GN/GL/GA/BD no importa).
+// Lo que no esta en la tabla se descarta en la ISR apenas se completa el campo de direccion.
+typedef struct {
+    char fmt[3];
+    void (*handler)(const char *fields);    // recibe los campos despues de "$ttFFF,"
+} gps_nmea_type_t;
+
+static void gps_nmea_gga(const char *fields);
+static void gps_nmea_rmc(const char *fields);
+
+static const gps_nmea_type_t gps_nmea_types[] = {
+    { {'G','G','A'}, gps_nmea_gga },
+    { {'R','M','C'}, gps_nmea_rmc },
+};
+#define GPS_NMEA_TYPES  (sizeof(gps_nmea_types) / sizeof(gps_nmea_types[0]))
+
+// Busca el formatter en la tabla. Devuelve el indice o -1. Se llama desde la ISR.
+static int8_t gps_nmea_lookup(const char *fmt){
+	for (uint8_t i = 0; i < GPS_NMEA_TYPES; i++) {
+		if (fmt[0] == gps_nmea_types[i].fmt[0] &&
+		    fmt[1] == gps_nmea_types[i].fmt[1] &&
+		    fmt[2] == gps_nmea_types[i].fmt[2]) return (int8_t)i;
+	}
+	return -1;
+}
+
+// Estado del armado de sentencias dentro de la ISR
+#define GPS_RX_WAIT_START  0    // descartando hasta el proximo '$'
+#define GPS_RX_ADDRESS     1    // "$ttFFF": al llegar la ',' se decide si el tipo interesa
+#define GPS_RX_IN_SENTENCE 2    // copiando en el slot gps_ring[head] y acumulando el XOR
+#define GPS_RX_CKSUM_HI    3    // despues del '*': nibble alto del checksum
+#define GPS_RX_CKSUM_LO    4    // nibble bajo: aca se acepta o se descarta
+#define GPS_RX_WAIT_EOL    5    // checksum OK, espero el '\n' para publicar
+#define GPS_RX_UBX_SYNC2   6    // llego 0xB5, espero 0x62 (de aca en adelante es binario)
+#define GPS_RX_UBX_CLASS   7
+#define GPS_RX_UBX_ID      8
+#define GPS_RX_UBX_LEN1    9
+#define GPS_RX_UBX_LEN2    10
+#define GPS_RX_UBX_PAYLOAD 11
+#define GPS_RX_UBX_CK_A    12
+#define GPS_RX_UBX_CK_B    13
+#define GPS_RX_UBX_SKIP    14   // frame que no se guarda: salteo payload + checksum
+static uint8_t rx_state = GPS_RX_WAIT_START;
+
+// Hora de llegada de cada sentencia: el callback corre al final de la rafaga (IDLE/HT/TC),
+// asi que al tick del callback se le resta lo que tardaron en llegar los bytes posteriores.
+static uint32_t rx_cb_tick;     // HAL_GetTick al entrar al callback
+static uint16_t rx_cb_left;     // bytes de este callback que todavia no se procesaron
+static uint32_t rx_start_tick;  // tick del '$' / sync UBX de la sentencia en curso
+static uint32_t gps_slot_tick;  // tick del slot que esta parseando GPS_Process
+static uint8_t rx_index = 0;
+static uint8_t rx_cksum = 0;
+static uint8_t rx_msg = 0;                  // indice en gps_nmea_types de la sentencia en curso
+static uint8_t rx_ck_a = 0, rx_ck_b = 0;    // Fletcher del frame UBX en curso
+static uint16_t rx_ubx_len = 0;             // largo de payload declarado
+static uint16_t rx_ubx_left = 0;            // bytes a saltear en GPS_RX_UBX_SKIP
+static bool rx_ubx_drop = false;            // el frame NAV en curso no se guarda (cola llena)
+static char *rx_ubx_buf;                    // destino del frame en curso: slot (NAV) o rx_ubx_ctrl
+static char rx_ubx_ctrl[GPSBUFSIZE];        // ACK y respuestas a polls: se atienden en CK_B, sin slot
+static volatile bool rx_resync = false;     // main -> ISR: descartar lo que quedo a medias
 //extern volatile int uart_receive_enabled;
 
 GPS_t GPS;
@@ -26,217 +107,1301 @@ int count_confRate_5hz = 0;
 int count_conf = 0;
 int count_confgsa_5hz = 0;
 
+// Perfil de configuracion deseado. En el arranque se pide (poll) cada setting al receptor
+// y solo se manda el CFG de los que difieren; si cambio algo se guarda en BBR una sola vez.
+#define GPS_CFG_MAX_ITEMS  16
+
+typedef struct {
+    const uint8_t *set;         // frame CFG con el valor deseado
+    uint16_t set_len;
+    uint64_t cmp_mask;          // bytes del payload que se comparan (bit i = byte i)
+    uint8_t  poll[UBX_FRAME_SIZE(2)];   // poll armado a partir de set
+    uint16_t poll_len;
+    bool     answered;          // el receptor contesto el poll
+} gps_cfg_item_t;
+
+#define GPS_CFG_IDLE      0
+#define GPS_CFG_CHECKING  1     // polls en vuelo (los que difieren ya se estan mandando)
+#define GPS_CFG_APPLYING  2     // CFG de los settings que no contestaron el poll
+#define GPS_CFG_SAVING    3     // CFG-CFG a BBR
+#define GPS_CFG_RUNTIME   4     // CFG en ejecucion (ahorro de energia, tasa de medicion)
+#define GPS_CFG_LINK      5     // buscando al receptor (probe de CFG-PRT), ver gps_link_step
+
+static gps_cfg_item_t gps_cfg_items[GPS_CFG_MAX_ITEMS];
+static uint8_t gps_cfg_count = 0;
+static uint8_t gps_cfg_state = GPS_CFG_IDLE;
+static uint8_t gps_cfg_changed = 0;     // settings reenviados en este arranque
+
+#define GPS_CMP_ALL(n)   ((1ull << (n)) - 1u)
+
+// Ahorro de energia (ver GPS_SetReportInterval)
+static gps_pwr_mode_t gps_pwr_mode = GPS_PWR_CONTINUOUS;
+static uint32_t gps_pwr_interval = 0;
+static bool gps_pwr_apply = false;          // falta mandar CFG-PM2 / CFG-RXM
+static bool gps_pwr_asleep = false;
+static bool gps_pwr_wait_fix = false;       // midiendo TTFF
+static bool gps_pwr_slept = false;          // se durmio y el main todavia no se entero (GPS_TakeSleep)
+static uint32_t gps_pwr_t_wake = 0;         // primer byte despues de dormir (o GPS_Init)
+static uint32_t gps_pwr_t_fix = 0;          // primer fix valido despues de t_wake
+static uint32_t gps_pwr_t_rx = 0;           // ultimo momento en que llegaron bytes
+static uint32_t gps_pwr_bytes = 0;
+static uint32_t gps_pwr_t_sleep = 0;        // backup: RXM-PMREQ enviado
+static uint32_t gps_pwr_sleep_ms = 0;
+static uint8_t gps_pwr_frame_pm2[UBX_FRAME_SIZE(UBX_LEN_CFG_PM2)];
+static uint8_t gps_pwr_frame_rxm[UBX_FRAME_SIZE(UBX_LEN_CFG_RXM)];
+static uint8_t gps_pwr_frame_req[UBX_FRAME_SIZE(UBX_LEN_RXM_PMREQ)];
+
+// Control de tasa de medicion (ver GPS_RATE_*)
+static uint16_t gps_rate_want = GPS_RATE_FAST_MS;
+static uint8_t  gps_rate_walks = 0;         // fixes seguidos caminando
+static uint32_t gps_rate_t_walk = 0;        // ultimo fix caminando
+static uint32_t gps_rate_t_move = 0;        // ultimo fix con movimiento (o sin fix confiable)
+static uint8_t  gps_rate_frame[UBX_FRAME_SIZE(UBX_LEN_CFG_RATE)];
+
+
+// Arranca la recepcion por DMA circular: el CPU solo se entera en HT, TC o IDLE
+static void GPS_StartRx(UART_HandleTypeDef *huart)
+{
+    rx_dma_pos = 0;
+    HAL_UARTEx_ReceiveToIdle_DMA(huart, rx_dma_buffer, sizeof(rx_dma_buffer));
+}
+
+
+
+// Cambia la velocidad de USART1 sin pasar por MspInit (pines y DMA quedan como estan)
+static void gps_uart_set_baud(uint32_t baud)
+{
+	HAL_UART_Abort(GPS_USART);
+	(GPS_USART)->Init.BaudRate = baud;
+	if (HAL_UART_Init(GPS_USART) != HAL_OK) {
+		Error_Handler();
+	}
+}
+
+// Agrega un setting al perfil. El poll es el mismo mensaje sin payload
+// (CFG-MSG lleva class/id del mensaje que se consulta).
+static void gps_cfg(const uint8_t *frame, uint16_t len, uint64_t cmp_mask)
+{
+	if (gps_cfg_count >= GPS_CFG_MAX_ITEMS) {
+		count_conf++;
+		return;
+	}
+	gps_cfg_item_t *it = &gps_cfg_items[gps_cfg_count++];
+	uint16_t poll_payload = (frame[3] == UBX_ID_CFG_MSG) ? 2 : 0;
+
+	it->set      = frame;
+	it->set_len  = len;
+	it->cmp_mask = cmp_mask;
+	it->answered = false;
+	it->poll_len = ubx_frame_build(it->poll, sizeof(it->poll), frame[2], frame[3], &frame[6], poll_payload);
+}
+
+// Respuesta a un poll: si coincide con el perfil no se manda nada; si difiere
+// el CFG sale ya, en el mismo pipeline que los polls que siguen en vuelo
+static void gps_cfg_on_poll(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+{
+	for (uint8_t i = 0; i < gps_cfg_count; i++) {
+		gps_cfg_item_t *it = &gps_cfg_items[i];
+		const uint8_t *want = &it->set[6];
+		uint16_t want_len = it->set_len - 8;
+
+		if (it->answered || it->set[2] != cls || it->set[3] != id) continue;
+		if (id == UBX_ID_CFG_MSG && (len < 2 || payload[0] != want[0] || payload[1] != want[1])) continue;
+
+		it->answered = true;
+		bool same = (len >= want_len);      // respuesta corta: se trata como distinta
+		for (uint8_t b = 0; same && b < want_len; b++) {
+			if ((it->cmp_mask & (1ull << b)) && payload[b] != want[b]) same = false;
+		}
+		if (!same) {
+			if (ubx_cfg_submit(it->set, it->set_len, 2, 1200) != UBX_OK) count_conf++;
+			gps_cfg_changed++;
+		}
+		return;
+	}
+}
+
+// ---- Busqueda del enlace (GPS_CFG_LINK) ----
+// Cada probe es un poll de CFG-PRT en el motor UBX (contesto = termino con ACK, sin error) y la
+// busqueda avanza desde GPS_Process cada vez que el motor queda vacio: el arranque no espera
+// al receptor.
+//   WARM:   probe a GPS_BAUD_TARGET (arranque en caliente: el puerto quedo guardado en BBR)
+//   SCAN:   probe en cada GPS_BAUD_CANDIDATES (defaults de fabrica, o reset del micro sin cortar el GPS)
+//   SWITCH: CFG-PRT a GPS_BAUD_TARGET mandado a la velocidad encontrada
+//   VERIFY: probe a GPS_BAUD_TARGET; si no contesta se vuelve a buscar una sola vez
+#define GPS_LINK_WARM    0
+#define GPS_LINK_SCAN    1
+#define GPS_LINK_SWITCH  2
+#define GPS_LINK_VERIFY  3
+
+static const uint32_t gps_link_candidates[] = GPS_BAUD_CANDIDATES;
+static uint8_t gps_link_stage = GPS_LINK_WARM;
+static uint8_t gps_link_idx = 0;            // SCAN: candidato en prueba
+static bool gps_link_switched = false;      // ya se mando CFG-PRT: no se insiste
+static uint32_t gps_link_t_switch = 0;
+static uint8_t gps_link_frame_prt[UBX_FRAME_SIZE(UBX_LEN_CFG_PRT)];
 
+// USART1 a otra velocidad: la RX por DMA se rearma y la ISR descarta lo que quedo a medias
+static void gps_link_set_baud(uint32_t baud){
+	gps_uart_set_baud(baud);
+	gps_stats.baud = baud;
+	rx_resync = true;
+	GPS_StartRx(GPS_USART);
+}
+
+static void gps_link_probe(uint32_t baud){
+	if (gps_stats.baud != baud) gps_link_set_baud(baud);
+	// un solo reintento: a la velocidad correcta el poll se contesta en < 1 epoca
+	if (ubx_cfg_submit(UBX_POLL_CFGPRT_UART1, sizeof(UBX_POLL_CFGPRT_UART1), 1, GPS_LINK_PROBE_MS) != UBX_OK) {
+		count_conf++;
+	}
+}
+
+// Enlace resuelto: consultar todo el perfil; lo que difiere se manda y se guarda en BBR
+// al final (gps_cfg_step)
+static void gps_link_done(void){
+	for (uint8_t i = 0; i < gps_cfg_count; i++) {
+		if (ubx_poll_submit(gps_cfg_items[i].poll, gps_cfg_items[i].poll_len, 1, 500, gps_cfg_on_poll) != UBX_OK) {
+			count_conf++;
+		}
+	}
+	gps_cfg_state = GPS_CFG_CHECKING;
+}
+
+// Avance de la busqueda con el motor vacio. errors = pedidos fallidos del paso anterior
+// (el probe sin respuesta no cuenta como error de configuracion)
+static void gps_link_step(uint8_t errors){
+	bool answered = (errors == 0);
+
+	switch (gps_link_stage) {
+	case GPS_LINK_WARM:
+	case GPS_LINK_VERIFY:
+		if (answered) {
+			if (gps_link_stage == GPS_LINK_VERIFY) gps_cfg_changed++;  // el puerto cambio: a BBR
+			gps_link_done();
+			return;
+		}
+		gps_link_stage = GPS_LINK_SCAN;
+		gps_link_idx = 0;
+		gps_link_probe(gps_link_candidates[0]);
+		return;
+
+	case GPS_LINK_SCAN:
+		if (answered) {
+			// ya esta en la velocidad final, o no tomo el cambio: queda en la que contesto
+			if (gps_stats.baud == GPS_BAUD_TARGET || gps_link_switched) {
+				gps_link_done();
+				return;
+			}
+			// sin reintentos: el ACK puede salir a cualquiera de las dos velocidades (o perderse)
+			uint16_t len = ubx_build_cfg_prt_uart1(gps_link_frame_prt, sizeof(gps_link_frame_prt), GPS_BAUD_TARGET);
+			if (ubx_cfg_submit(gps_link_frame_prt, len, 0, GPS_LINK_SWITCH_MS) != UBX_OK) {
+				gps_link_done();
+				return;
+			}
+			gps_link_switched = true;
+			gps_link_t_switch = HAL_GetTick();
+			gps_link_stage = GPS_LINK_SWITCH;
+			return;
+		}
+		if (++gps_link_idx < sizeof(gps_link_candidates) / sizeof(gps_link_candidates[0])) {
+			gps_link_probe(gps_link_candidates[gps_link_idx]);
+			return;
+		}
+		// sin respuesta a ninguna velocidad: queda a 9600 esperando NMEA por defecto
+		gps_link_set_baud(9600);
+		count_conf++;
+		gps_link_done();
+		return;
+
+	case GPS_LINK_SWITCH:
+		// el frame ya salio (ACK o timeout); el receptor aplica CFG-PRT y reinicia el puerto
+		if ((HAL_GetTick() - gps_link_t_switch) < GPS_LINK_SWITCH_MS) return;
+		gps_link_stage = GPS_LINK_VERIFY;
+		gps_link_probe(GPS_BAUD_TARGET);
+		return;
+
+	default:
+		gps_link_done();
+		return;
+	}
+}
 
 void GPS_Init()
 {
 
-	ubx_status_t s;
-
-	    s = gps_send_cfg_retry(GPS_USART, UBX_CFGRATE_5HZ, sizeof(UBX_CFGRATE_5HZ),
-	                           2, 200, 1200);
-	    if (s != UBX_OK) {
-	    	count_conf++;
-	    }
-
-	    s =gps_send_cfg_retry(GPS_USART, UBX_CFGMSG_GLL_UART1_OFF_BODY, sizeof(UBX_CFGMSG_GLL_UART1_OFF_BODY), 2, 500, 1200);
-	    if (s != UBX_OK) {
-	    	count_conf++;
-	    }
-	    s =gps_send_cfg_retry(GPS_USART, UBX_CFGMSG_GSA_UART1_OFF_BODY, sizeof(UBX_CFGMSG_GSA_UART1_OFF_BODY), 2, 500, 1200);
-	    if (s != UBX_OK) {
-	    	count_conf++;
-	    }
-	    s =gps_send_cfg_retry(GPS_USART, UBX_CFGMSG_GSV_UART1_OFF_BODY, sizeof(UBX_CFGMSG_GSV_UART1_OFF_BODY), 2, 500, 1200);
-	    if (s != UBX_OK) {
-	    	count_conf++;
-	    }
-	    s =gps_send_cfg_retry(GPS_USART, UBX_CFGMSG_VTG_UART1_OFF_BODY, sizeof(UBX_CFGMSG_VTG_UART1_OFF_BODY), 2, 500, 1200);
-	    if (s != UBX_OK) {
-	    	count_conf++;
-	    }
-
-	    s = gps_send_cfg_retry(GPS_USART, UBX_CFGMSG_GGA_UART1_ON_BODY, sizeof(UBX_CFGMSG_GGA_UART1_ON_BODY), 2, 500, 1200);
-	    if (s != UBX_OK) {
-	    	count_conf++;
-	    }
-
-	    s = gps_send_cfg_retry(GPS_USART, UBX_CFGMSG_RMC_UART1_ON_BODY, sizeof(UBX_CFGMSG_RMC_UART1_ON_BODY), 2, 500, 1200);
-	    if (s != UBX_OK) {
-	  	    	count_conf++;
-	  	    }
-
-	    // 4) NAV5 (recomendado)
-	    s = gps_send_cfg_retry(GPS_USART, UBX_CFGNAV5_CATTLE_BODY, sizeof(UBX_CFGNAV5_CATTLE_BODY),
-	                             2, 500, 1200);
-	    if (s != UBX_OK) {
-	  	    	count_conf++;
-	  	    }
-
-
-	    if (count_conf>1){
-	    	for(int i=0; i<100; i++){
-	    		HAL_GPIO_TogglePin(GPIOD, LED_Pin);
-	    		HAL_Delay(50);
-	    	 }
-	    	}
-	    // 5) Guardar en BBR (no crítico; darle más tiempo)
-	   // (void)gps_send_cfg_retry(GPS_USART, UBX_CFGCFG_SAVE_ALL_BBR, sizeof(UBX_CFGCFG_SAVE_ALL_BBR),  1, 500, 3000);
-
-	    // 6) recién ahora habilitás RX IT para NMEA
-	    HAL_UART_Receive_IT(GPS_USART, &rx_data, 1);
-
-	//uart_receive_enabl	ed=1;
-	//HAL_NVIC_EnableIRQ(USART1_IRQn);
-	HAL_UART_Receive_IT(GPS_USART, &rx_data, 1);
-}
-
-
-void GPS_UART_CallBack(){
-	//deberia añadir un chekeo de primer simbolo
-	if (rx_data != '\n' && rx_index < sizeof(rx_buffer)) {
-		rx_buffer[rx_index++] = rx_data; // guarda en rx en la posicion del indice, el dato que  esta en RX_Data
-
-		// este dato es un unit_t
+	gps_cfg_count   = 0;
+	gps_cfg_changed = 0;
+
+	// contador de ciclos (DWT) para medir la carga del callback de RX
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	// la RX por DMA arranca antes de configurar: los ACK llegan por el mismo camino que el NMEA
+	gps_link_set_baud(GPS_BAUD_TARGET);
+	gps_pwr_t_wake = gps_pwr_t_rx = HAL_GetTick();
+	gps_pwr_wait_fix = true;            // primer TTFF: desde el arranque
+	gps_stats.rate_ms = GPS_RATE_FAST_MS;   // UBX_CFGRATE_5HZ (verificado abajo)
+	gps_rate_want = GPS_RATE_FAST_MS;
+	gps_rate_t_walk = gps_rate_t_move = gps_pwr_t_wake;
+
+	// la configuracion se verifica y se completa en segundo plano desde GPS_Process
+	gps_cfg(UBX_CFGRATE_5HZ, sizeof(UBX_CFGRATE_5HZ), GPS_CMP_ALL(UBX_LEN_CFG_RATE));
+
+	gps_cfg(UBX_CFGMSG_GLL_UART1_OFF, sizeof(UBX_CFGMSG_GLL_UART1_OFF), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_GSA_UART1_OFF, sizeof(UBX_CFGMSG_GSA_UART1_OFF), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_GSV_UART1_OFF, sizeof(UBX_CFGMSG_GSV_UART1_OFF), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_VTG_UART1_OFF, sizeof(UBX_CFGMSG_VTG_UART1_OFF), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+
+#if (GPS_MODE == GPS_MODE_UBX)
+	// modo binario: sin NMEA, solo mensajes NAV
+	gps_cfg(UBX_CFGMSG_GGA_UART1_OFF, sizeof(UBX_CFGMSG_GGA_UART1_OFF), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_RMC_UART1_OFF, sizeof(UBX_CFGMSG_RMC_UART1_OFF), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+#if (GPS_UBX_GEN >= 7)
+	gps_cfg(UBX_CFGMSG_NAVPVT_UART1_ON, sizeof(UBX_CFGMSG_NAVPVT_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+#else
+	gps_cfg(UBX_CFGMSG_NAVPOSLLH_UART1_ON, sizeof(UBX_CFGMSG_NAVPOSLLH_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_NAVVELNED_UART1_ON, sizeof(UBX_CFGMSG_NAVVELNED_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_NAVTIMEUTC_UART1_ON, sizeof(UBX_CFGMSG_NAVTIMEUTC_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_NAVSTATUS_UART1_ON, sizeof(UBX_CFGMSG_NAVSTATUS_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+#endif
+#else
+	gps_cfg(UBX_CFGMSG_GGA_UART1_ON, sizeof(UBX_CFGMSG_GGA_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+	gps_cfg(UBX_CFGMSG_RMC_UART1_ON, sizeof(UBX_CFGMSG_RMC_UART1_ON), GPS_CMP_ALL(UBX_LEN_CFG_MSG));
+#endif
+
+	// 4) NAV5 (recomendado): solo dynModel (byte 2) y staticHoldThresh (byte 22),
+	// el resto del payload del poll son valores que no tocamos
+	gps_cfg(UBX_CFGNAV5_CATTLE, sizeof(UBX_CFGNAV5_CATTLE), (1ull << 2) | (1ull << 22));
+
+	// 5) buscar al receptor en segundo plano; con el enlace resuelto se consulta todo el
+	// perfil (gps_link_done). GPS_Init vuelve enseguida: el resto del arranque no lo espera
+	gps_link_stage = GPS_LINK_WARM;
+	gps_link_switched = false;
+	gps_link_probe(GPS_BAUD_TARGET);
+	gps_cfg_state = GPS_CFG_LINK;
+
+	// el primer frame sale ahora; los siguientes los encadenan el fin de TX y los ACK
+	ubx_cfg_poll(GPS_USART);
+}
+
+
+// Valor de un digito hex ASCII (mayuscula o minuscula); -1 si no es hex.
+static int8_t nmea_hex_nibble(uint8_t c){
+	if (c >= '0' && c <= '9') return (int8_t)(c - '0');
+	if (c >= 'A' && c <= 'F') return (int8_t)(c - 'A' + 10);
+	if (c >= 'a' && c <= 'f') return (int8_t)(c - 'a' + 10);
+	return -1;
+}
+
+static void gps_rx_byte(uint8_t rx_data);
+
+static uint32_t gps_rx_start_tick(void){
+	uint32_t byte_us = (gps_stats.baud != 0) ? 10000000u / gps_stats.baud : 0u;
+	return rx_cb_tick - ((uint32_t)rx_cb_left * byte_us) / 1000u;
+}
+
+// ACK-ACK / ACK-NAK (payload = class, id reconocido) y respuestas a polls (CFG, MON, ...).
+// Corre en la ISR de RX: cada respuesta libera lugar en la ventana y el siguiente frame sale ya.
+// f = class, id, payload.
+static void gps_ubx_ctrl(const uint8_t *f, uint16_t len){
+	const uint8_t *p = &f[2];
+	uint16_t n = len - 2;
+
+	if (f[0] == UBX_CLASS_ACK) {
+		if (n >= 2) ubx_cfg_on_ack(f[1], p[0], p[1]);
 	} else {
+		ubx_on_frame(f[0], f[1], p, n);
+	}
+	ubx_cfg_poll(GPS_USART);
+}
 
-		if(GPS_validate((char*) rx_buffer)) //Casteo los datos del Buffes a una cadena de chars, si es valido
-			GPS_parse((char*) rx_buffer);
-		rx_index = 0;
-		memset(rx_buffer, 0, sizeof(rx_buffer));
+// Frames UBX dentro de la ISR: mismo esquema que NMEA, el Fletcher se acumula byte a byte
+// y el frame se publica (class, id, payload) solo si los dos bytes de checksum coinciden.
+static void gps_rx_ubx_byte(gps_slot_t *slot, uint8_t rx_data){
+	switch (rx_state) {
+	case GPS_RX_UBX_SYNC2:
+		if (rx_data != 0x62) {
+			rx_state = GPS_RX_WAIT_START;
+			if (rx_data == '$') gps_rx_byte(rx_data);   // no era UBX: no pierdo la sentencia
+			return;
+		}
+		rx_state = GPS_RX_UBX_CLASS;
+		return;
+
+	case GPS_RX_UBX_CLASS:
+		rx_ck_a = rx_data;
+		rx_ck_b = rx_data;
+		// solo NAV usa la cola; ACK y respuestas a polls no dependen de que el main consuma.
+		// Si la cola esta llena igual sigo el header para poder saltear el frame entero
+		rx_ubx_drop = false;
+		if (rx_data == UBX_CLASS_NAV) {
+			rx_ubx_buf = slot->data;
+			rx_ubx_drop = ((uint8_t)(gps_ring_head - gps_ring_tail) >= GPS_SENTENCE_SLOTS);
+		} else {
+			rx_ubx_buf = rx_ubx_ctrl;
+		}
+		if (!rx_ubx_drop) rx_ubx_buf[0] = (char)rx_data;
+		rx_state = GPS_RX_UBX_ID;
+		return;
+
+	case GPS_RX_UBX_ID:
+		rx_ck_a += rx_data; rx_ck_b += rx_ck_a;
+		if (!rx_ubx_drop) rx_ubx_buf[1] = (char)rx_data;
+		rx_state = GPS_RX_UBX_LEN1;
+		return;
+
+	case GPS_RX_UBX_LEN1:
+		rx_ck_a += rx_data; rx_ck_b += rx_ck_a;
+		rx_ubx_len = rx_data;
+		rx_state = GPS_RX_UBX_LEN2;
+		return;
+
+	case GPS_RX_UBX_LEN2:
+		rx_ck_a += rx_data; rx_ck_b += rx_ck_a;
+		rx_ubx_len |= (uint16_t)rx_data << 8;
+		if (rx_ubx_len > GPS_UBX_MAX_LEN) {
+			// 0xB5 0x62 en la basura de la linea: no saltear hasta 64 KiB esperando el checksum
+			gps_stats.malformed++;
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		if (rx_ubx_drop || rx_ubx_len > GPSBUFSIZE - 2) {
+			if (rx_ubx_drop) gps_stats.dropped_full++;
+			else             gps_stats.dropped_long++;
+			rx_ubx_left = rx_ubx_len + 2;
+			rx_state = GPS_RX_UBX_SKIP;
+			return;
+		}
+		rx_index = 2;
+		rx_state = (rx_ubx_len != 0) ? GPS_RX_UBX_PAYLOAD : GPS_RX_UBX_CK_A;
+		return;
+
+	case GPS_RX_UBX_PAYLOAD:
+		rx_ck_a += rx_data; rx_ck_b += rx_ck_a;
+		rx_ubx_buf[rx_index++] = (char)rx_data;
+		if (rx_index == rx_ubx_len + 2) rx_state = GPS_RX_UBX_CK_A;
+		return;
+
+	case GPS_RX_UBX_CK_A:
+		if (rx_data != rx_ck_a) {
+			gps_stats.checksum_errors++;
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		rx_state = GPS_RX_UBX_CK_B;
+		return;
+
+	case GPS_RX_UBX_CK_B:
+		if (rx_data != rx_ck_b) {
+			gps_stats.checksum_errors++;
+		} else if (rx_ubx_buf == rx_ubx_ctrl) {
+			// ACK y respuestas a polls se atienden aca: la configuracion avanza aunque
+			// el main loop todavia no corra (TempService_Init, LoRa_init, ...) o no de abasto
+			gps_ubx_ctrl((const uint8_t*)rx_ubx_ctrl, rx_index);
+			gps_stats.ubx_frames++;
+		} else {
+			slot->type = GPS_SLOT_UBX;
+			slot->len = rx_index;
+			slot->tick = rx_start_tick;
+			__DMB();                    // el slot tiene que estar escrito antes de publicarlo
+			gps_ring_head++;
+			gps_stats.ubx_frames++;
+		}
+		rx_state = GPS_RX_WAIT_START;
+		return;
+
+	case GPS_RX_UBX_SKIP:
+		if (--rx_ubx_left == 0) rx_state = GPS_RX_WAIT_START;
+		return;
+
+	default:
+		rx_state = GPS_RX_WAIT_START;
+		return;
 	}
-	//if(uart_receive_enabled){
-		HAL_UART_Receive_IT(GPS_USART, &rx_data, 1);
-	//}
 }
 
+// Armado de sentencias en la ISR: costo O(1) por byte, nada de parsear aca.
+// El XOR del checksum se va acumulando a medida que llegan los bytes ('$' < ... < '*'),
+// y apenas se completan los 2 nibbles despues del '*' se compara numericamente:
+// si no coincide la sentencia se descarta ahi mismo, sin una segunda pasada.
+static void gps_rx_byte(uint8_t rx_data){
+	gps_slot_t *slot = &gps_ring[gps_ring_head % GPS_SENTENCE_SLOTS];
+	int8_t nib;
+
+	// dentro de un frame UBX cualquier valor (incluido '$') es payload
+	if (rx_state >= GPS_RX_UBX_SYNC2) {
+		gps_rx_ubx_byte(slot, rx_data);
+		return;
+	}
+
+	if (rx_data == 0xB5) {
+		// sync UBX: nunca aparece en NMEA (ASCII < 0x80)
+		if (rx_state != GPS_RX_WAIT_START) gps_stats.malformed++;
+		rx_start_tick = gps_rx_start_tick();
+		rx_state = GPS_RX_UBX_SYNC2;
+		return;
+	}
+
+	if (rx_data == '$') {
+		// inicio de sentencia (si venia otra a medias, se pierde y resincronizo)
+		if ((uint8_t)(gps_ring_head - gps_ring_tail) >= GPS_SENTENCE_SLOTS) {
+			gps_stats.dropped_full++;   // el main no consumio a tiempo
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		slot->data[0] = '$';
+		rx_start_tick = gps_rx_start_tick();
+		rx_index = 1;
+		rx_cksum = 0;
+		rx_state = GPS_RX_ADDRESS;
+		return;
+	}
+
+	switch (rx_state) {
+	case GPS_RX_ADDRESS:
+		if (rx_data == ',') {
+			// "$" + talker (2) + formatter (3); las propietarias ($P...) no tienen talker
+			int8_t msg = (rx_index == 6 && slot->data[1] != 'P') ? gps_nmea_lookup(&slot->data[3]) : -1;
+			if (msg < 0) {
+				gps_stats.filtered++;   // tipo no registrado: no ocupa slot ni tiempo de parseo
+				rx_state = GPS_RX_WAIT_START;
+				return;
+			}
+			rx_msg = (uint8_t)msg;
+			rx_state = GPS_RX_IN_SENTENCE;
+		} else if (rx_data == '*' || rx_data == '\r' || rx_data == '\n') {
+			gps_stats.malformed++;
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		} else if (rx_index >= 6) {
+			gps_stats.filtered++;       // direccion mas larga que "$ttFFF"
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		rx_cksum ^= rx_data;
+		break;
+
+	case GPS_RX_IN_SENTENCE:
+		if (rx_data == '*') {
+			rx_state = GPS_RX_CKSUM_HI;
+		} else if (rx_data == '\r' || rx_data == '\n') {
+			gps_stats.malformed++;      // termino sin campo de checksum
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		} else {
+			rx_cksum ^= rx_data;
+		}
+		break;
 
-int GPS_validate(char *nmeastr){
-	char check[3];
-	char checkcalcstr[3];
-	int i;
-	int calculated_check;
+	case GPS_RX_CKSUM_HI:
+		nib = nmea_hex_nibble(rx_data);
+		if (nib < 0) {
+			gps_stats.malformed++;
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		rx_cksum ^= (uint8_t)(nib << 4);    // al final tiene que quedar en 0
+		rx_state = GPS_RX_CKSUM_LO;
+		break;
 
-	i=0;
-	calculated_check=0;
+	case GPS_RX_CKSUM_LO:
+		nib = nmea_hex_nibble(rx_data);
+		if (nib < 0) {
+			gps_stats.malformed++;
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		if ((rx_cksum ^ (uint8_t)nib) != 0) {
+			gps_stats.checksum_errors++;
+			rx_state = GPS_RX_WAIT_START;
+			return;
+		}
+		rx_state = GPS_RX_WAIT_EOL;
+		break;
 
-	// check to ensure that the string starts with a $
-	if(nmeastr[i] == '$')
-		i++;
-	else
-		return 0;
+	case GPS_RX_WAIT_EOL:
+		if (rx_data == '\r') return;
+		if (rx_data == '\n') {
+			slot->data[rx_index] = '\0';
+			slot->type = GPS_SLOT_NMEA;
+			slot->msg = rx_msg;
+			slot->len = rx_index;
+			slot->tick = rx_start_tick;
+			__DMB();                    // el slot tiene que estar escrito antes de publicarlo
+			gps_ring_head++;
+			gps_stats.sentences++;
+		} else {
+			gps_stats.malformed++;      // basura despues del checksum
+		}
+		rx_state = GPS_RX_WAIT_START;
+		return;
 
-	//No NULL reached, 75 char largest possible NMEA message, no '*' reached
-	while((nmeastr[i] != 0) && (nmeastr[i] != '*') && (i < 75)){
-		calculated_check ^= nmeastr[i];// calculate the checksum hace el Xor bit a bit
-		i++;
+	default:
+		return;
 	}
 
-	if(i >= 75){
-		return 0;// the string was too long so return an error
+	// bytes de la sentencia (incluido "*hh") al slot
+	if (rx_index < sizeof(slot->data) - 1) {
+		slot->data[rx_index++] = (char)rx_data;
+	} else {
+		gps_stats.dropped_long++;       // no entra en el slot: la descarto entera
+		rx_state = GPS_RX_WAIT_START;
 	}
+}
+
+static void gps_rx_span(uint16_t from, uint16_t to){
+	for (uint16_t i = from; i < to; i++) {
+		rx_cb_left--;
+		gps_rx_byte(rx_dma_buffer[i]);
+	}
+	gps_stats.rx_bytes += (uint32_t)(to - from);
+}
+
+// Se llama desde HAL_UARTEx_RxEventCallback (HT, TC o IDLE).
+// rx_pos es la posicion de escritura del DMA: proceso lo nuevo desde rx_dma_pos.
+// Peor caso acotado: HT/TC garantizan a lo sumo GPS_DMA_RX_SIZE/2 bytes nuevos por evento
+// y cada byte cuesta O(1), asi que el tiempo maximo no depende del contenido de la sentencia.
+void GPS_UART_CallBack(uint16_t rx_pos){
+	uint32_t t0 = DWT->CYCCNT;
+
+	if (rx_pos > sizeof(rx_dma_buffer)) return;
+	gps_stats.rx_events++;
 
-	if (nmeastr[i] == '*'){
-		check[0] = nmeastr[i+1];    //put hex chars in check string
-		check[1] = nmeastr[i+2];
-		check[2] = 0;
+	// el receptor se apago y volvio: lo que quedo a medias antes de dormir no sigue con esto
+	if (rx_resync) {
+		rx_resync = false;
+		rx_state = GPS_RX_WAIT_START;
+		gps_stats.rx_resyncs++;
 	}
-	else
-		return 0;// no checksum separator found there for invalid
 
-	sprintf(checkcalcstr,"%02X",calculated_check);
-	return((checkcalcstr[0] == check[0])
-			&& (checkcalcstr[1] == check[1])) ? 1 : 0 ;
+	rx_cb_tick = HAL_GetTick();
+	rx_cb_left = (rx_pos >= rx_dma_pos) ? (uint16_t)(rx_pos - rx_dma_pos)
+	                                    : (uint16_t)(sizeof(rx_dma_buffer) - rx_dma_pos + rx_pos);
+	if (rx_pos > rx_dma_pos) {
+		gps_rx_span(rx_dma_pos, rx_pos);
+	} else if (rx_pos < rx_dma_pos) {
+		// el DMA dio la vuelta: primero la cola del buffer y despues el principio
+		gps_rx_span(rx_dma_pos, sizeof(rx_dma_buffer));
+		gps_rx_span(0, rx_pos);
+	}
+	rx_dma_pos = (rx_pos == sizeof(rx_dma_buffer)) ? 0 : rx_pos;
+
+	uint32_t dt = DWT->CYCCNT - t0;
+	gps_stats.rx_cycles += dt;
+	if (dt > gps_stats.isr_max_cycles) gps_stats.isr_max_cycles = dt;
 }
 
-void GPS_parse(char *GPSstrParse){
-	if(!strncmp(GPSstrParse, "$GPGGA", 6)){ //string compare develve un 0 cuando las cadenas son iguales, por lo que nesesito negarlo prra obterner un 1  y que se cumpla el if
-		if (sscanf(GPSstrParse, "$GPGGA,%f,%f,%c,%f,%c,%d,%d,%f,%f,%c", &GGA.utc_time, &GGA.nmea_latitude, &GGA.ns, &GGA.nmea_longitude, &GGA.ew, &GGA.lock, &GGA.satelites, &GGA.hdop, &GGA.msl_altitude, &GGA.msl_units) >= 1){
-			//GPS.dec_latitude = GPS_nmea_to_dec(GPS.nmea_latitude, GPS.ns);
-			//GPS.dec_longitude = GPS_nmea_to_dec(GPS.nmea_longitude, GPS.ew);
-			return;// aca deberia ver de dejar de usar ssacanf
+// Fin de TX por DMA en USART1: sale el siguiente frame de configuracion en cola.
+void GPS_UART_TxCallBack(void){
+	ubx_cfg_poll(GPS_USART);
+}
 
-		}
+// Un ORE aborta la recepcion DMA (los errores de ruido/framing no): si quedo parada, la rearmo
+void GPS_UART_ErrorCallBack(void){
+	if ((GPS_USART)->RxState == HAL_UART_STATE_READY) {
+		gps_stats.rx_restarts++;
+		rx_state = GPS_RX_WAIT_START;
+		GPS_StartRx(GPS_USART);
 	}
-	else if (!strncmp(GPSstrParse, "$GPRMC", 6)) {
-	    int n = sscanf(GPSstrParse,
-	                   "$GPRMC,%lf,%c,%lf,%c,%lf,%c,%f,%f,%d",
-	                   &RMC.utc_time,
-	                   &RMC.status,
-	                   &RMC.nmea_latitude, &RMC.ns,
-	                   &RMC.nmea_longitude, &RMC.ew,
-	                   &RMC.speed_k,
-	                   &RMC.course_d,
-	                   &RMC.date);
+}
+
+GPS_Stats_t GPS_GetStats(void){
+	return gps_stats;
+}
+
+// ---- Armado de epocas ----
+// Cada sentencia/mensaje aporta una parte del fix. Las partes se juntan por clave de epoca
+// (utc_time en NMEA, iTOW en UBX) y el fix se publica entero cuando llega la ultima parte.
+// Si cambia la clave con una epoca a medias, esa epoca se descarta (no se mezclan epocas).
+#define GPS_PART_POS     0x01   // GGA / NAV-POSLLH
+#define GPS_PART_VEL     0x02   // RMC / NAV-VELNED
+#define GPS_PART_TIME    0x04   // NAV-TIMEUTC
+#define GPS_PART_STATUS  0x08   // NAV-STATUS
+#if (GPS_MODE == GPS_MODE_UBX)
+#define GPS_EPOCH_PARTS  (GPS_PART_POS | GPS_PART_VEL | GPS_PART_TIME | GPS_PART_STATUS)
+#else
+#define GPS_EPOCH_PARTS  (GPS_PART_POS | GPS_PART_VEL)
+#endif
 
-	    if (n == 9) {
-	        return; // parse OK
-	    }
-	    // si n != 9: parse falló o faltan campos (por ejemplo, sin fix)
+static GPS_t gps_epoch;             // fix en armado (solo contexto main)
+static uint32_t gps_epoch_key = 0;
+static uint8_t gps_epoch_parts = 0;
+
+// Publicacion con seqlock: impar = escritura en curso.
+// GPS es la copia publicada; se lee con GPS_GetFix().
+static volatile uint32_t gps_fix_seq = 0;
+
+static void gps_pwr_on_fix(const GPS_t *fix);
+static void gps_rate_on_fix(const GPS_t *fix);
+
+static void gps_fix_publish(const GPS_t *fix){
+	gps_pwr_on_fix(fix);
+	gps_rate_on_fix(fix);
+	gps_fix_seq++;
+	__DMB();
+	GPS = *fix;
+	__DMB();
+	gps_fix_seq++;
+	gps_stats.fixes++;
+}
+
+static GPS_t *gps_epoch_begin(uint32_t key){
+	if (gps_epoch_parts != 0 && key != gps_epoch_key) {
+		gps_stats.epochs_partial++;
+		gps_epoch_parts = 0;
 	}
+	if (gps_epoch_parts == 0) {
+		memset(&gps_epoch, 0, sizeof(gps_epoch));
+		gps_epoch_key = key;
+		gps_epoch.tick_ms = gps_slot_tick;    // primer byte de la epoca: ancla de timebase.c
+	}
+	return &gps_epoch;
 }
-/*
-	else if (!strncmp(GPSstrParse, "$GPGLL", 6)){
-		if(sscanf(GPSstrParse, "$GPGLL,%f,%c,%f,%c,%f,%c", &GPS.nmea_latitude, &GPS.ns, &GPS.nmea_longitude, &GPS.ew, &GPS.utc_time, &GPS.gll_status) >= 1)
-			return;
+
+// Posicion filtrada en el fix; la del receptor queda en raw_latitude / raw_longitude
+static void gps_filter_fix(GPS_t *fix){
+	fix->raw_latitude  = fix->latitude;
+	fix->raw_longitude = fix->longitude;
+	fix->filter = GPS_FILTER_INIT;
+#if (GPS_FILTER_ENABLE == 1)
+	static gps_filter_t filter;
+
+	if (fix->lock == 0) return;
+	// sin HDOP (modo UBX): hAcc de 2.5 m ~ HDOP 1.0
+	uint32_t q = fix->hdop;
+	if (q == 0 && fix->h_acc_mm != 0) q = fix->h_acc_mm / 25u;
+	if (q > 0xFFFFu) q = 0xFFFFu;
+
+	uint32_t t0 = DWT->CYCCNT;
+	fix->filter = (uint8_t)gps_filter_update(&filter, &fix->latitude, &fix->longitude,
+	                                         (uint16_t)q, (uint8_t)fix->satelites, fix->tick_ms);
+	uint32_t dt = DWT->CYCCNT - t0;
+	if (dt > gps_stats.filter_max_cycles) gps_stats.filter_max_cycles = dt;
+	gps_stats.filter_outliers = filter.outliers;
+	gps_stats.filter_resets   = filter.resets;
+#endif
+}
+
+static void gps_epoch_add(uint8_t parts){
+	gps_epoch_parts |= parts;
+	if ((gps_epoch_parts & GPS_EPOCH_PARTS) == GPS_EPOCH_PARTS) {
+		gps_filter_fix(&gps_epoch);
+		gps_fix_publish(&gps_epoch);
+		gps_epoch_parts = 0;
 	}
-	else if (!strncmp(GPSstrParse, "$GPVTG", 6)){
-		if(sscanf(GPSstrParse, "$GPVTG,%f,%c,%f,%c,%f,%c,%f,%c", &GPS.course_t, &GPS.course_t_unit, &GPS.course_m, &GPS.course_m_unit, &GPS.speed_k, &GPS.speed_k_unit, &GPS.speed_km, &GPS.speed_km_unit) >= 1)
+}
+
+// Copia el ultimo fix publicado sin mezclar epocas (reintenta si GPS_Process publico en el medio).
+// *seq es la secuencia que ya vio el lector: devuelve true si el fix es nuevo y la actualiza.
+// No llamar desde una ISR que pueda interrumpir a GPS_Process (el reintento no terminaria).
+bool GPS_GetFix(GPS_t *out, uint32_t *seq){
+	uint32_t s1, s2;
+
+	do {
+		s1 = gps_fix_seq;
+		__DMB();
+		*out = GPS;
+		__DMB();
+		s2 = gps_fix_seq;
+	} while (s1 != s2 || (s1 & 1u));
+
+	bool is_new = (s1 != *seq);
+	*seq = s1;
+	return is_new;
+}
+
+// ---- Decodificacion de mensajes NAV (GPS_MODE_UBX) ----
+// Los campos UBX ya vienen en enteros: lat/lon en 1e-7 grados (gps_coord_t directo).
+
+// hh, mm, ss + nano -> hhmmss.sss x1000 (mismo formato que GGA/RMC)
+static uint32_t gps_ubx_utc_time(const uint8_t *hms, int32_t nano){
+	uint32_t ms = (nano > 0) ? (uint32_t)nano / 1000000u : 0u;
+	return ((uint32_t)hms[0] * 10000u + (uint32_t)hms[1] * 100u + hms[2]) * 1000u + ms;
+}
+
+// year (U2), month, day -> ddmmyy
+static int gps_ubx_date(const uint8_t *ymd){
+	return (int)ymd[3] * 10000 + (int)ymd[2] * 100 + (int)(ubx_get_u16(ymd) % 100u);
+}
+
+static void gps_ubx_set_fix(GPS_t *fix, uint8_t fix_type, bool fix_ok){
+	fix_ok = fix_ok && (fix_type >= 2) && (fix_type <= 4);
+	fix->fix_type   = fix_type;
+	fix->lock       = fix_ok ? 1 : 0;
+	fix->rmc_status = fix_ok ? 'A' : 'V';
+}
+
+// Todos los mensajes NAV empiezan con iTOW (ms): es la clave de epoca en modo UBX
+static void gps_handle_ubx(const uint8_t *f, uint8_t len){
+	const uint8_t *p = &f[2];
+	uint16_t n = (uint16_t)(len - 2);
+	GPS_t *fix;
+
+	// ACK y respuestas a polls ya se atendieron en la ISR (gps_ubx_ctrl)
+	if (f[0] != UBX_CLASS_NAV || n < 4) return;
+
+	switch (f[1]) {
+	case UBX_ID_NAV_PVT:
+		if (n < UBX_LEN_NAV_PVT) return;
+		fix = gps_epoch_begin(ubx_get_u32(p));
+		if ((p[11] & 0x03) == 0x03) {              // validDate + validTime
+			fix->utc_time = gps_ubx_utc_time(&p[8], ubx_get_i32(&p[16]));
+			fix->date     = gps_ubx_date(&p[4]);
+		}
+		gps_ubx_set_fix(fix, p[20], (p[21] & 0x01) != 0);
+		fix->satelites   = p[23];
+		fix->longitude   = ubx_get_i32(&p[24]);
+		fix->latitude    = ubx_get_i32(&p[28]);
+		fix->altitude_cm = ubx_get_i32(&p[36]) / 10;   // hMSL en mm
+		fix->h_acc_mm    = ubx_get_u32(&p[40]);
+		fix->speed_k     = (uint32_t)ubx_get_i32(&p[60]) * 3600u / 1852u;   // mm/s -> kn x1000
+		fix->course_d    = (uint32_t)ubx_get_i32(&p[64]) / 1000u;           // 1e-5 -> x100 grados
+		fix->pdop        = ubx_get_u16(&p[76]);        // NAV-PVT solo trae pDOP (x100); hdop queda en 0
+		gps_epoch_add(GPS_PART_POS | GPS_PART_VEL | GPS_PART_TIME | GPS_PART_STATUS);
+		break;
+
+	case UBX_ID_NAV_POSLLH:
+		if (n < UBX_LEN_NAV_POSLLH) return;
+		fix = gps_epoch_begin(ubx_get_u32(p));
+		fix->longitude   = ubx_get_i32(&p[4]);
+		fix->latitude    = ubx_get_i32(&p[8]);
+		fix->altitude_cm = ubx_get_i32(&p[16]) / 10;
+		fix->h_acc_mm    = ubx_get_u32(&p[20]);
+		gps_epoch_add(GPS_PART_POS);
+		break;
+
+	case UBX_ID_NAV_VELNED:
+		if (n < UBX_LEN_NAV_VELNED) return;
+		fix = gps_epoch_begin(ubx_get_u32(p));
+		fix->speed_k     = ubx_get_u32(&p[20]) * 36000u / 1852u;   // cm/s -> kn x1000
+		fix->course_d    = (uint32_t)ubx_get_i32(&p[24]) / 1000u;
+		gps_epoch_add(GPS_PART_VEL);
+		break;
+
+	case UBX_ID_NAV_TIMEUTC:
+		if (n < UBX_LEN_NAV_TIMEUTC) return;
+		fix = gps_epoch_begin(ubx_get_u32(p));
+		if (p[19] & 0x04) {                        // validUTC
+			fix->utc_time = gps_ubx_utc_time(&p[16], ubx_get_i32(&p[8]));
+			fix->date     = gps_ubx_date(&p[12]);
+		}
+		gps_epoch_add(GPS_PART_TIME);
+		break;
+
+	case UBX_ID_NAV_STATUS:
+		if (n < UBX_LEN_NAV_STATUS) return;
+		fix = gps_epoch_begin(ubx_get_u32(p));
+		gps_ubx_set_fix(fix, p[4], (p[5] & 0x01) != 0);
+		gps_epoch_add(GPS_PART_STATUS);
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Avance de la verificacion de configuracion cada vez que el motor UBX queda vacio
+static void gps_cfg_step(void){
+	uint8_t errors = ubx_cfg_take_errors();
+
+	switch (gps_cfg_state) {
+	case GPS_CFG_LINK:
+		gps_link_step(errors);
+		return;
+
+	case GPS_CFG_CHECKING:
+		// un poll sin respuesta no es una falla: ese setting se manda igual
+		gps_stats.cfg_polls_ok = 0;
+		for (uint8_t i = 0; i < gps_cfg_count; i++) {
+			gps_cfg_item_t *it = &gps_cfg_items[i];
+			if (it->answered) {
+				gps_stats.cfg_polls_ok++;
+				continue;
+			}
+			if (ubx_cfg_submit(it->set, it->set_len, 2, 1200) != UBX_OK) count_conf++;
+			gps_cfg_changed++;
+		}
+		// cada poll sin respuesta dejo un error en el motor; el resto son CFG que fallaron
+		errors = (errors > gps_cfg_count - gps_stats.cfg_polls_ok) ? errors - (gps_cfg_count - gps_stats.cfg_polls_ok) : 0;
+		gps_stats.cfg_errors += errors;
+		count_conf += errors;
+		gps_cfg_state = GPS_CFG_APPLYING;
+		if (!ubx_cfg_idle()) return;
+		errors = 0;                         // no quedo nada por aplicar
+		/* fall through */
+
+	case GPS_CFG_APPLYING:
+		gps_stats.cfg_errors += errors;
+		count_conf += errors;
+		gps_stats.cfg_changed = gps_cfg_changed;
+		if (gps_cfg_changed == 0) {
+			gps_cfg_state = GPS_CFG_IDLE;   // el receptor ya tenia el perfil: nada que guardar
 			return;
+		}
+		if (ubx_cfg_submit(UBX_CFGCFG_SAVE_ALL_BBR, sizeof(UBX_CFGCFG_SAVE_ALL_BBR), 1, 3000) != UBX_OK) {
+			count_conf++;
+		}
+		gps_cfg_state = GPS_CFG_SAVING;
+		return;
+
+	case GPS_CFG_SAVING:
+	case GPS_CFG_RUNTIME:
+		gps_stats.cfg_errors += errors;
+		count_conf += errors;
+		gps_cfg_state = GPS_CFG_IDLE;
+		return;
+
+	default:
+		gps_cfg_state = GPS_CFG_IDLE;
+		return;
 	}
-}¨*/
+}
+
+// ---- Ahorro de energia ----
+// El modo sale del intervalo de reporte. En ON/OFF y backup el receptor deja de transmitir
+// mientras duerme: el silencio en la UART marca que se durmio y el primer byte que vuelve,
+// que desperto. Al dormir se le pide a la ISR que descarte la sentencia/frame a medias y se
+// tira la epoca en armado; el TTFF se mide desde ese primer byte hasta el primer fix valido.
+// En backup la configuracion vuelve desde BBR (ver CFG-CFG al final de gps_cfg_step).
+static gps_pwr_mode_t gps_pwr_select(uint32_t interval_ms){
+	if (interval_ms < GPS_PWR_CYCLIC_MIN_MS) return GPS_PWR_CONTINUOUS;
+	if (interval_ms < GPS_PWR_ONOFF_MIN_MS)  return GPS_PWR_CYCLIC;
+	if (interval_ms < GPS_PWR_BACKUP_MIN_MS) return GPS_PWR_ONOFF;
+	return GPS_PWR_BACKUP;
+}
+
+// true una vez por cada vez que el receptor se durmio (ON/OFF o backup): hasta que despierte
+// no llegan fixes, asi que lo que espera al proximo fix (ej. track_flush) se hace ahora.
+// Contexto main, igual que GPS_Process.
+bool GPS_TakeSleep(void){
+	bool slept = gps_pwr_slept;
+	gps_pwr_slept = false;
+	return slept;
+}
 
-float GPS_nmea_to_dec(float deg_coord, char nsew) { // el formato NMEA se presenta como DDMM.MMMM
-	int degree = (int)(deg_coord/100); // divido por 100 para quedarme con solo DD y lo casteo a int
-	float minutes = deg_coord - degree*100; // los minutos van a ser la diferenvia entre el dato que me da
-	// y el dato entero que despejo por 100
-	float dec_deg = minutes / 60;  // si a ese resultado anterior lo divido por 60 obtengo los minutos
-	float decimal = degree + dec_deg; // la suma de los grados+ minutos es el valor que en realidad busco
-	if (nsew == 'S' || nsew == 'W') { // return negative
-		decimal *= -1; // si es norte o oeste es un dato negativo -
+// Intervalo entre reportes de la aplicacion. El cambio de modo sale desde GPS_Process
+// cuando termina la configuracion de arranque.
+void GPS_SetReportInterval(uint32_t interval_ms){
+	gps_pwr_interval = interval_ms;
+	gps_pwr_mode = gps_pwr_select(interval_ms);
+	gps_pwr_apply = true;
+	gps_stats.pwr_mode = (uint8_t)gps_pwr_mode;
+}
+
+static void gps_pwr_send_config(void){
+	bool save = (gps_pwr_mode == GPS_PWR_CYCLIC || gps_pwr_mode == GPS_PWR_ONOFF);
+	uint16_t len;
+
+	// fuera de continuo la tasa la fija el modo (ver gps_rate_update): 1 Hz, que es lo
+	// que admite el power save de u-blox 6; el periodo de reporte lo da updatePeriod de PM2
+	if (gps_pwr_mode != GPS_PWR_CONTINUOUS && gps_stats.rate_ms != GPS_RATE_MID_MS) {
+		len = ubx_build_cfg_rate(gps_rate_frame, sizeof(gps_rate_frame), GPS_RATE_MID_MS);
+		if (ubx_cfg_submit(gps_rate_frame, len, 2, 1200) != UBX_OK) count_conf++;
+		gps_stats.rate_ms = GPS_RATE_MID_MS;
+		gps_stats.rate_changes++;
+	}
+
+	if (save) {
+		uint32_t flags = UBX_PM2_FLAGS_BASE;
+#if (GPS_UBX_GEN >= 8)
+		if (gps_pwr_mode == GPS_PWR_CYCLIC) flags |= UBX_PM2_MODE_CYCLIC;
+#endif
+		// si no hay fix, reintentar a los 10 s como minimo (default de u-blox)
+		uint32_t search = (gps_pwr_interval > 10000u) ? gps_pwr_interval : 10000u;
+		len = ubx_build_cfg_pm2(gps_pwr_frame_pm2, sizeof(gps_pwr_frame_pm2), flags, gps_pwr_interval, search);
+		if (ubx_cfg_submit(gps_pwr_frame_pm2, len, 2, 1200) != UBX_OK) count_conf++;
 	}
-	return decimal;
+	// backup: continuo mientras esta despierto, lo duerme RXM-PMREQ
+	len = ubx_build_cfg_rxm(gps_pwr_frame_rxm, sizeof(gps_pwr_frame_rxm), save);
+	if (ubx_cfg_submit(gps_pwr_frame_rxm, len, 2, 1200) != UBX_OK) count_conf++;
+	gps_cfg_state = GPS_CFG_RUNTIME;
 }
 
+static void gps_pwr_sleeping(void){
+	gps_pwr_asleep = true;
+	gps_pwr_slept = true;
+	gps_pwr_wait_fix = false;
+	gps_epoch_parts = 0;                // la epoca a medias no se completa despues de dormir
+	rx_resync = true;
+}
 
+static void gps_pwr_on_fix(const GPS_t *fix){
+	if (!gps_pwr_wait_fix || fix->lock == 0) return;
 
+	gps_pwr_wait_fix = false;
+	gps_pwr_t_fix = HAL_GetTick();
+	gps_stats.ttff_last_ms = gps_pwr_t_fix - gps_pwr_t_wake;
+	if (gps_stats.ttff_last_ms > gps_stats.ttff_max_ms) gps_stats.ttff_max_ms = gps_stats.ttff_last_ms;
+}
 
-// Funciones de utils que a lo mejor voy a necesitar:
+// Backup por tiempo: duerme lo que falta para completar el intervalo desde que desperto
+static void gps_pwr_backup(uint32_t now){
+	uint32_t awake = now - gps_pwr_t_wake;
+	uint32_t sleep = (gps_pwr_interval > awake + GPS_PWR_MIN_SLEEP_MS) ? gps_pwr_interval - awake
+	                                                                   : GPS_PWR_MIN_SLEEP_MS;
+	uint16_t len = ubx_build_rxm_pmreq(gps_pwr_frame_req, sizeof(gps_pwr_frame_req), sleep);
 
-static void GPS_PauseRx(UART_HandleTypeDef *huart)
-{
-    // Detiene la recepción por interrupción que estaba armada con HAL_UART_Receive_IT()
-    HAL_UART_AbortReceive_IT(huart);
+	// RXM-PMREQ no tiene ACK: va directo, con el motor vacio y la TX libre (16 bytes)
+	if (ubx_send_frame(GPS_USART, gps_pwr_frame_req, len, 10) != UBX_OK) return;
+	gps_pwr_t_sleep = now;
+	gps_pwr_sleep_ms = sleep;
+	gps_pwr_sleeping();
+}
 
-    // Limpia Overrun Error si ocurrió (depende de familia; en F1 suele bastar con leer SR/DR)
-    __HAL_UART_CLEAR_OREFLAG(huart);
+static void gps_pwr_update(void){
+	uint32_t now = HAL_GetTick();
+	uint32_t bytes = gps_stats.rx_bytes;
 
-    // limpiar flags generales:
-    __HAL_UART_CLEAR_PEFLAG(huart);
-    __HAL_UART_CLEAR_FEFLAG(huart);
-    __HAL_UART_CLEAR_NEFLAG(huart);
+	if (gps_pwr_apply && gps_cfg_state == GPS_CFG_IDLE && ubx_cfg_idle()) {
+		gps_pwr_apply = false;
+		gps_pwr_send_config();
+	}
+
+	if (bytes != gps_pwr_bytes) {
+		gps_pwr_bytes = bytes;
+		gps_pwr_t_rx = now;
+		if (gps_pwr_asleep) {
+			gps_pwr_asleep = false;
+			gps_pwr_wait_fix = true;
+			gps_pwr_t_wake = now;
+			gps_stats.wakes++;
+		}
+	} else if (!gps_pwr_asleep && (now - gps_pwr_t_rx) >= GPS_PWR_SILENCE_MS
+	           && (gps_pwr_mode == GPS_PWR_ONOFF || gps_pwr_mode == GPS_PWR_BACKUP)) {
+		gps_pwr_sleeping();
+	}
+
+	if (gps_pwr_mode != GPS_PWR_BACKUP) return;
 
-    // Reseteá tu parser NMEA
-    rx_index = 0;
-    memset(rx_buffer, 0, sizeof(rx_buffer));
+	if (gps_pwr_asleep) {
+		// no volvio solo: cualquier flanco en su RX lo despierta
+		if ((now - gps_pwr_t_sleep) >= gps_pwr_sleep_ms + GPS_PWR_WAKE_GRACE_MS) {
+			static const uint8_t wake[] = { 0xFF, 0xFF, 0xFF, 0xFF };
+			(void)HAL_UART_Transmit(GPS_USART, (uint8_t*)wake, sizeof(wake), 10);
+			gps_pwr_t_sleep = now;
+			gps_pwr_sleep_ms = 0;
+		}
+		return;
+	}
+	if (gps_cfg_state != GPS_CFG_IDLE || gps_pwr_apply || !ubx_cfg_idle()) return;
+	if ((GPS_USART)->gState != HAL_UART_STATE_READY) return;
+
+	if (gps_pwr_wait_fix) {
+		if ((now - gps_pwr_t_wake) < GPS_PWR_FIX_TIMEOUT_MS) return;
+		gps_stats.ttff_timeouts++;          // sin cielo: no gastar bateria esperando
+		gps_pwr_backup(now);
+	} else if ((now - gps_pwr_t_fix) >= GPS_PWR_HOLD_MS) {
+		gps_pwr_backup(now);
+	}
 }
 
-static void GPS_ResumeRx(UART_HandleTypeDef *huart)
-{
-    // Reanuda recepción byte a byte por interrupción
-    HAL_UART_Receive_IT(huart, &rx_data, 1);
+// ---- Tasa de medicion segun el movimiento ----
+// Cada fix publicado clasifica al animal (caminando / moviendose / quieto) y ajusta la tasa
+// deseada; el CFG-RATE sale desde GPS_Process. Menos epocas por segundo bajan juntos el
+// consumo del receptor, los bytes por la UART y el parseo en el micro.
+static void gps_rate_on_fix(const GPS_t *fix){
+	uint32_t now = HAL_GetTick();
+	uint16_t want = gps_rate_want;
+	bool stable = (fix->lock != 0);
+
+	// la calidad se juzga con HDOP si lo hay; si no, con pDOP (NAV-PVT) y su propio umbral
+	if (fix->hdop != 0)      stable = stable && (fix->hdop <= GPS_RATE_HDOP_MAX);
+	else if (fix->pdop != 0) stable = stable && (fix->pdop <= GPS_RATE_PDOP_MAX);
+
+	if (!stable) {
+		// sin fix confiable la velocidad no dice nada: no bajar, y salir de 0.1 Hz
+		gps_rate_walks = 0;
+		gps_rate_t_move = now;
+		if (want == GPS_RATE_SLOW_MS) want = GPS_RATE_MID_MS;
+		gps_rate_want = want;
+		return;
+	}
+
+	if (fix->speed_k >= GPS_RATE_WALK_KN) {
+		gps_rate_t_walk = now;
+		gps_rate_t_move = now;
+		if (gps_rate_walks < GPS_RATE_UP_FIXES) gps_rate_walks++;
+		if (gps_rate_walks >= GPS_RATE_UP_FIXES) want = GPS_RATE_FAST_MS;
+		else if (want == GPS_RATE_SLOW_MS) want = GPS_RATE_MID_MS;
+	} else {
+		gps_rate_walks = 0;
+		if (fix->speed_k >= GPS_RATE_MOVE_KN) {
+			gps_rate_t_move = now;
+			if (want == GPS_RATE_SLOW_MS) want = GPS_RATE_MID_MS;   // a 0.1 Hz no se espera otro fix
+		}
+	}
+
+	if (want == GPS_RATE_FAST_MS && (now - gps_rate_t_walk) >= GPS_RATE_WALK_HOLD_MS) want = GPS_RATE_MID_MS;
+	if (want == GPS_RATE_MID_MS && (now - gps_rate_t_move) >= GPS_RATE_REST_MS) want = GPS_RATE_SLOW_MS;
+	gps_rate_want = want;
 }
 
-void GPS_ApplyUbxConfig_Runtime(UART_HandleTypeDef *huart)
-{
-    GPS_PauseRx(huart);
+static void gps_rate_update(void){
+	if (gps_rate_want == gps_stats.rate_ms) return;
+	// solo en continuo: en cyclic y ON/OFF el periodo lo manda CFG-PM2 (y u-blox 6 no admite
+	// mas de 1 Hz en power save); en backup el receptor pasa casi todo el tiempo apagado
+	if (gps_pwr_mode != GPS_PWR_CONTINUOUS) return;
+	if (gps_cfg_state != GPS_CFG_IDLE || gps_pwr_apply || !ubx_cfg_idle()) return;
+
+	uint16_t len = ubx_build_cfg_rate(gps_rate_frame, sizeof(gps_rate_frame), gps_rate_want);
+	if (ubx_cfg_submit(gps_rate_frame, len, 2, 1200) != UBX_OK) return;
+	gps_cfg_state = GPS_CFG_RUNTIME;
+	gps_stats.rate_ms = gps_rate_want;
+	gps_stats.rate_changes++;
+}
+
+// Uso del enlace: bits recibidos en la ventana / bits que entran a la velocidad actual.
+// rx_bytes lo escribe la ISR; una lectura de 32 bits es atomica en Cortex-M3.
+static void gps_link_load_update(void){
+	static uint32_t t_win = 0;
+	static uint32_t bytes_win = 0;
+	uint32_t now = HAL_GetTick();
+	uint32_t dt = now - t_win;
+
+	if (dt < GPS_LOAD_WINDOW_MS) return;
+
+	uint32_t bytes = gps_stats.rx_bytes;
+	if (t_win != 0 && gps_stats.baud != 0) {
+		// 10 bits por byte (8N1)
+		uint64_t used = (uint64_t)(bytes - bytes_win) * 10u * 1000u * 1000u;
+		uint32_t load = (uint32_t)(used / ((uint64_t)gps_stats.baud * dt));
+		gps_stats.link_load_pm = (load > 1000u) ? 1000u : (uint16_t)load;
+		if (gps_stats.link_load_pm > gps_stats.link_load_max_pm)
+			gps_stats.link_load_max_pm = gps_stats.link_load_pm;
+	}
+	t_win = now;
+	bytes_win = bytes;
+}
+
+// Consumidor (contexto main): parsea todas las sentencias pendientes.
+void GPS_Process(void){
+	gps_link_load_update();
+
+	while (gps_ring_tail != gps_ring_head) {
+		gps_slot_t *slot = &gps_ring[gps_ring_tail % GPS_SENTENCE_SLOTS];
+
+		// el checksum ya se verifico en la ISR
+		uint32_t t0 = DWT->CYCCNT;
+		gps_slot_tick = slot->tick;
+		if (slot->type == GPS_SLOT_UBX)
+			gps_handle_ubx((const uint8_t*)slot->data, slot->len);
+		else
+			gps_nmea_types[slot->msg].handler(slot->data + 7);
+		uint32_t dt = DWT->CYCCNT - t0;
+		if (dt > gps_stats.parse_max_cycles) gps_stats.parse_max_cycles = dt;
+
+		__DMB();                        // termine de leer el slot antes de liberarlo
+		gps_ring_tail++;
+	}
+
+	// configuracion UBX en segundo plano (los ACK ya se procesaron arriba)
+	ubx_cfg_poll(GPS_USART);
+	if (gps_cfg_state != GPS_CFG_IDLE && ubx_cfg_idle()) {
+		gps_cfg_step();
+	}
+	gps_pwr_update();
+	gps_rate_update();
+}
+
+
+// ---- Lector de campos NMEA (sin sscanf ni float) ----
+
+// Devuelve el campo actual (puntero + largo) y deja *p en el siguiente.
+// Los campos terminan en ',', '*' o '\0'; pasado el ultimo campo devuelve largo 0.
+static uint8_t nmea_next_field(const char **p, const char **field){
+	const char *s = *p;
+	uint8_t len = 0;
 
-    // Mandás configs y esperás ACK (opcional, pero vos querés siempre validar)
-    ubx_status_t r1 = ubx_send_body_wait_ack(huart, UBX_CFGMSG_GGA_UART1_ON_BODY, sizeof(UBX_CFGMSG_GGA_UART1_ON_BODY), 200, 1200);
-    ubx_status_t r2 = ubx_send_body_wait_ack(huart, UBX_CFGMSG_RMC_UART1_ON_BODY, sizeof(UBX_CFGMSG_RMC_UART1_ON_BODY), 200, 1200);
+	*field = s;
+	while (s[len] != ',' && s[len] != '*' && s[len] != '\0') len++;
 
-    // Acá tomás acciones correctivas según r1/r2 (reintento, log, fallback, etc.)
+	*p = (s[len] == ',') ? &s[len + 1] : &s[len];
+	return len;
+}
+
+// "123.4567" con frac=3 -> 123456 (trunca los decimales de mas, completa con ceros).
+// Campo vacio o con basura -> false (el que llama decide que valor poner).
+static bool nmea_to_fixed(const char *f, uint8_t len, uint8_t frac, int32_t *out){
+	int32_t v = 0;
+	uint8_t i = 0, frac_digits = 0;
+	bool neg = false, dot = false;
+
+	if (len == 0) return false;
+	if (f[0] == '-') { neg = true; i = 1; }
+
+	for (; i < len; i++) {
+		char c = f[i];
+		if (c == '.') {
+			if (dot) return false;
+			dot = true;
+			continue;
+		}
+		if (c < '0' || c > '9') return false;
+		if (dot) {
+			if (frac_digits >= frac) continue;
+			frac_digits++;
+		}
+		if (v > (INT32_MAX - 9) / 10) return false; // no entra en 32 bits
+		v = v * 10 + (c - '0');
+	}
+	for (; frac_digits < frac; frac_digits++) {
+		if (v > INT32_MAX / 10) return false;
+		v *= 10;
+	}
+
+	*out = neg ? -v : v;
+	return true;
+}
+
+// Lee el proximo campo como entero escalado; vacio -> 0.
+// Devuelve false solo si el campo tiene caracteres que no son un numero.
+static bool nmea_take_fixed(const char **p, uint8_t frac, int32_t *out){
+	const char *f;
+	uint8_t len = nmea_next_field(p, &f);
+
+	*out = 0;
+	if (len == 0) return true;
+	return nmea_to_fixed(f, len, frac, out);
+}
+
+// "ddmm.mmmmm" / "dddmm.mmmmm" -> 1e-7 grados, directo desde los digitos (sin float).
+// Los grados son lo que esta antes de los 2 digitos enteros de minutos.
+static bool nmea_to_coord(const char *f, uint8_t len, gps_coord_t *out){
+	uint8_t dot = 0;
+	int32_t deg, min_e5;
+
+	while (dot < len && f[dot] != '.') dot++;
+	if (dot < 3 || dot > 5) return false;          // 1..3 digitos de grados + 2 de minutos
+
+	if (!nmea_to_fixed(f, dot - 2, 0, &deg)) return false;
+	if (!nmea_to_fixed(f + dot - 2, len - (dot - 2), 5, &min_e5)) return false;
+	if (deg < 0 || deg > 180 || min_e5 < 0 || min_e5 >= 6000000) return false;
+
+	// minutos/60 en 1e-7 grados = min_e5 * 100 / 60 = min_e5 * 5 / 3 (redondeado)
+	*out = deg * GPS_COORD_SCALE + (min_e5 * 5 + 1) / 3;
+	return true;
+}
 
-    GPS_ResumeRx(huart);
+// Campo NMEA crudo ("4807.03812") + hemisferio -> gps_coord_t.
+// Campo vacio o invalido -> 0.
+gps_coord_t GPS_nmea_to_coord(const char *field, uint8_t len, char nsew){
+	gps_coord_t c;
+	if (!nmea_to_coord(field, len, &c)) return 0;
+	return gps_coord_apply_hemi(c, nsew);
+}
+
+// Lee el proximo campo como un caracter ('N', 'A', 'M', ...); vacio -> '\0'.
+static char nmea_take_char(const char **p){
+	const char *f;
+	return nmea_next_field(p, &f) ? f[0] : '\0';
+}
+
+// Lee coordenada + hemisferio (dos campos); vacio -> 0 y '\0'.
+static bool nmea_take_coord(const char **p, gps_coord_t *out, char *nsew){
+	const char *f;
+	uint8_t len = nmea_next_field(p, &f);
+	bool ok = true;
+
+	*out = 0;
+	if (len != 0) ok = nmea_to_coord(f, len, out);
+	*nsew = nmea_take_char(p);
+	*out = gps_coord_apply_hemi(*out, *nsew);
+	return ok;
+}
+
+// $xxGGA,hhmmss.ss,ddmm.mmmmm,N,dddmm.mmmmm,E,q,nn,h.h,a.a,M,...
+static bool gps_parse_gga(const char *p, GPS_GGA *out){
+	int32_t v;
+	bool ok = true;
+
+	ok &= nmea_take_fixed(&p, 3, &v); out->utc_time = (uint32_t)v;
+	ok &= nmea_take_coord(&p, &out->latitude, &out->ns);
+	ok &= nmea_take_coord(&p, &out->longitude, &out->ew);
+	ok &= nmea_take_fixed(&p, 0, &v); out->lock = (int)v;
+	ok &= nmea_take_fixed(&p, 0, &v); out->satelites = (int)v;
+	ok &= nmea_take_fixed(&p, 2, &v); out->hdop = (uint16_t)v;
+	ok &= nmea_take_fixed(&p, 2, &out->msl_altitude);
+	out->msl_units = nmea_take_char(&p);
+
+	return ok;
+}
+
+// $xxRMC,hhmmss.ss,A,ddmm.mmmmm,N,dddmm.mmmmm,E,s.sss,c.cc,ddmmyy,...
+static bool gps_parse_rmc(const char *p, GPS_RMC *out){
+	int32_t v;
+	bool ok = true;
+
+	ok &= nmea_take_fixed(&p, 3, &v); out->utc_time = (uint32_t)v;
+	out->status = nmea_take_char(&p);
+	ok &= nmea_take_coord(&p, &out->latitude, &out->ns);
+	ok &= nmea_take_coord(&p, &out->longitude, &out->ew);
+	ok &= nmea_take_fixed(&p, 3, &v); out->speed_k = (uint32_t)v;
+	ok &= nmea_take_fixed(&p, 2, &v); out->course_d = (uint32_t)v;
+	ok &= nmea_take_fixed(&p, 0, &v); out->date = (int)v;
+
+	return ok;
+}
+
+// Parsea sobre una copia local y solo publica en GGA/RMC si todos los campos eran validos.
+// Los campos vacios (sin fix) quedan en 0 / '\0'; la validez la dicen lock y status.
+static void gps_nmea_gga(const char *fields){
+	GPS_GGA gga;
+	if (!gps_parse_gga(fields, &gga)) return;
+
+	GGA = gga;
+	GPS_t *fix = gps_epoch_begin(gga.utc_time);
+	fix->latitude    = gga.latitude;
+	fix->longitude   = gga.longitude;
+	fix->altitude_cm = gga.msl_altitude;
+	fix->utc_time    = gga.utc_time;
+	fix->lock        = gga.lock;
+	fix->satelites   = gga.satelites;
+	fix->hdop        = gga.hdop;
+	gps_epoch_add(GPS_PART_POS);
+}
+
+static void gps_nmea_rmc(const char *fields){
+	GPS_RMC rmc;
+	if (!gps_parse_rmc(fields, &rmc)) return;
+
+	RMC = rmc;
+	GPS_t *fix = gps_epoch_begin(rmc.utc_time);
+	fix->utc_time    = rmc.utc_time;
+	fix->rmc_status  = rmc.status;
+	fix->speed_k     = rmc.speed_k;
+	fix->course_d    = rmc.course_d;
+	fix->date        = rmc.date;
+	gps_epoch_add(GPS_PART_VEL);
+}
+
+// Parseo de una sentencia suelta (sin checksum): GPS_Process ya llega con el tipo
+// resuelto por la ISR y llama directo al handler.
+void GPS_parse(char *GPSstrParse){
+	if (strnlen(GPSstrParse, 7) < 7) return;
+	if (GPSstrParse[0] != '$' || GPSstrParse[1] == 'P' || GPSstrParse[6] != ',') return;
+
+	int8_t msg = gps_nmea_lookup(&GPSstrParse[3]);
+	if (msg >= 0) gps_nmea_types[msg].handler(GPSstrParse + 7);
+}
+/*
+	else if (!strncmp(GPSstrParse, "$GPGLL", 6)){
+		if(sscanf(GPSstrParse, "$GPGLL,%f,%c,%f,%c,%f,%c", &GPS.nmea_latitude, &GPS.ns, &GPS.nmea_longitude, &GPS.ew, &GPS.utc_time, &GPS.gll_status) >= 1)
+			return;
+	}
+	else if (!strncmp(GPSstrParse, "$GPVTG", 6)){
+		if(sscanf(GPSstrParse, "$GPVTG,%f,%c,%f,%c,%f,%c,%f,%c", &GPS.course_t, &GPS.course_t_unit, &GPS.course_m, &GPS.course_m_unit, &GPS.speed_k, &GPS.speed_k_unit, &GPS.speed_km, &GPS.speed_km_unit) >= 1)
+			return;
+	}
+}¨*/
+
+// Reconfiguracion en caliente: los CFG salen por el motor no bloqueante y los ACK vuelven
+// por la misma RX por DMA, asi que el NMEA sigue llegando y no se pierden fixes.
+ubx_status_t GPS_ApplyUbxConfig_Runtime(void)
+{
+    ubx_status_t r = ubx_cfg_submit(UBX_CFGMSG_GGA_UART1_ON, sizeof(UBX_CFGMSG_GGA_UART1_ON), 2, 1200);
+    if (r != UBX_OK) return r;
+    return ubx_cfg_submit(UBX_CFGMSG_RMC_UART1_ON, sizeof(UBX_CFGMSG_RMC_UART1_ON), 2, 1200);
 }
 
@@ -0,0 +1,125 @@
+/*
+ * gps_filter.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#include "gps_filter.h"
+
+// 1e-7 grados de latitud = 11.132 mm (111.32 km por grado)
+#define MM_PER_UNIT_Q10   11399     // 11.132 * 1024
+#define UNIT_PER_MM_Q16   5887      // 65536 / 11.132
+
+// cos(lat) en Q15 con la aproximacion de Bhaskara (error < 0.2 %), en centesimas de grado:
+// cos(d) ~ (32400 - 4 d^2) / (32400 + d^2) con d en grados. Solo al elegir el origen.
+int32_t gps_filter_cos_q15(gps_coord_t lat){
+	int64_t d = (lat < 0 ? -(int64_t)lat : (int64_t)lat) / 100000;   // 0.01 grado
+	int64_t d2 = d * d;
+	int32_t c = (int32_t)(((324000000 - 4 * d2) << 15) / (324000000 + d2));
+	return (c < 512) ? 512 : c;     // cerca del polo no hay vacas: evita dividir por ~0
+}
+
+static void gps_filter_origin(gps_filter_t *f, gps_coord_t lat, gps_coord_t lon){
+	f->lat0 = lat;
+	f->lon0 = lon;
+	f->cos_q15 = gps_filter_cos_q15(lat);
+	f->x_mm = 0;
+	f->y_mm = 0;
+}
+
+static void gps_filter_to_plane(const gps_filter_t *f, gps_coord_t lat, gps_coord_t lon, int32_t *x, int32_t *y){
+	int32_t dy = (int32_t)(((int64_t)(lat - f->lat0) * MM_PER_UNIT_Q10) >> 10);
+	int32_t dx = (int32_t)(((int64_t)(lon - f->lon0) * MM_PER_UNIT_Q10) >> 10);
+	*y = dy;
+	*x = (int32_t)(((int64_t)dx * f->cos_q15) >> 15);
+}
+
+static void gps_filter_from_plane(const gps_filter_t *f, gps_coord_t *lat, gps_coord_t *lon){
+	int32_t dlat = (int32_t)(((int64_t)f->y_mm * UNIT_PER_MM_Q16 + (1 << 15)) >> 16);
+	int32_t dx   = (int32_t)(((int64_t)f->x_mm * UNIT_PER_MM_Q16 + (1 << 15)) >> 16);
+	*lat = f->lat0 + dlat;
+	*lon = f->lon0 + (int32_t)(((int64_t)dx << 15) / f->cos_q15);
+}
+
+static int32_t gps_filter_abs(int32_t v){ return (v < 0) ? -v : v; }
+
+static int32_t gps_filter_clamp(int32_t v, int32_t lim){
+	if (v > lim) return lim;
+	if (v < -lim) return -lim;
+	return v;
+}
+
+void gps_filter_reset(gps_filter_t *f){
+	f->init = false;
+	f->rejects = 0;
+}
+
+static gps_filter_result_t gps_filter_start(gps_filter_t *f, gps_coord_t lat, gps_coord_t lon, uint32_t t_ms){
+	gps_filter_origin(f, lat, lon);
+	f->vx_mm_s = 0;
+	f->vy_mm_s = 0;
+	f->t_ms = t_ms;
+	f->rejects = 0;
+	f->init = true;
+	return GPS_FILTER_INIT;
+}
+
+gps_filter_result_t gps_filter_update(gps_filter_t *f, gps_coord_t *lat, gps_coord_t *lon,
+                                      uint16_t hdop, uint8_t sats, uint32_t t_ms){
+	uint32_t dt = t_ms - f->t_ms;
+	int32_t zx, zy;
+
+	if (!f->init || dt > GPS_FILTER_RESET_MS) return gps_filter_start(f, *lat, *lon, t_ms);
+	if (dt == 0) dt = 1;
+	if (hdop == 0) hdop = 200;
+
+	// prediccion a velocidad constante
+	int32_t px = f->x_mm + f->vx_mm_s * (int32_t)dt / 1000;
+	int32_t py = f->y_mm + f->vy_mm_s * (int32_t)dt / 1000;
+
+	gps_filter_to_plane(f, *lat, *lon, &zx, &zy);
+	int32_t rx = zx - px;
+	int32_t ry = zy - py;
+
+	// |r| ~ max + min/2 (sin raiz, error < 12 %) contra lo que se puede mover en dt + el ruido esperado
+	int32_t ax = gps_filter_abs(rx), ay = gps_filter_abs(ry);
+	int32_t norm = (ax > ay) ? ax + ay / 2 : ay + ax / 2;
+	int32_t gate = GPS_FILTER_VMAX_MM_S * (int32_t)dt / 1000 + GPS_FILTER_GATE_MM * (int32_t)hdop / 100;
+
+	f->t_ms = t_ms;
+	if (norm > gate) {
+		f->outliers++;
+		if (++f->rejects >= GPS_FILTER_MAX_REJECTS) {
+			// no era un salto: el filtro quedo lejos (reacquisicion, multipath largo)
+			f->resets++;
+			gps_filter_start(f, *lat, *lon, t_ms);
+			return GPS_FILTER_RESET;
+		}
+		f->x_mm = px;
+		f->y_mm = py;
+		gps_filter_from_plane(f, lat, lon);
+		return GPS_FILTER_OUTLIER;
+	}
+	f->rejects = 0;
+	f->updates++;
+
+	// ganancias: alfa baja con el HDOP (y a la mitad con pocos satelites), beta = alfa^2 / (2 - alfa)
+	int32_t alpha = GPS_FILTER_ALPHA_Q8 * 100 / ((hdop < 100) ? 100 : hdop);
+	if (sats < 6) alpha /= 2;
+	if (alpha < GPS_FILTER_ALPHA_MIN_Q8) alpha = GPS_FILTER_ALPHA_MIN_Q8;
+	int32_t beta = alpha * alpha / (512 - alpha);
+
+	f->x_mm = px + alpha * rx / 256;
+	f->y_mm = py + alpha * ry / 256;
+	f->vx_mm_s = gps_filter_clamp(f->vx_mm_s + (beta * rx / 256) * 1000 / (int32_t)dt, GPS_FILTER_VMAX_MM_S);
+	f->vy_mm_s = gps_filter_clamp(f->vy_mm_s + (beta * ry / 256) * 1000 / (int32_t)dt, GPS_FILTER_VMAX_MM_S);
+
+	gps_filter_from_plane(f, lat, lon);
+
+	// lejos del origen la proyeccion pierde precision: el origen pasa a ser la estimacion
+	if (gps_filter_abs(f->x_mm) > GPS_FILTER_RECENTER_MM || gps_filter_abs(f->y_mm) > GPS_FILTER_RECENTER_MM) {
+		gps_filter_origin(f, *lat, *lon);
+	}
+	return GPS_FILTER_OK;
+}
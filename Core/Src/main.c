@@ -18,6 +18,7 @@
 /* USER CODE END Header */
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "dma.h"
 #include "spi.h"
 #include "usart.h"
 #include "gpio.h"
@@ -27,6 +28,10 @@
 #include "gps.h"
 #include "service_temp.h"
 #include "LoRa.h"
+#include "uplink.h"
+#include "track.h"
+#include "geofence.h"
+#include "timebase.h"
 
 
 /* USER CODE END Includes */
@@ -38,6 +43,10 @@
 
 /* Private define ------------------------------------------------------------*/
 /* USER CODE BEGIN PD */
+#define REPORT_INTERVAL_MS  1500   // periodo de uplink; tambien elige el ahorro de energia del GPS
+#define TRACK_BATCH_MS      30000  // un punto clave no espera mas que esto a completar la trama
+#define HEARTBEAT_MS        60000  // sin puntos clave (sin fix) igual se manda el ultimo fix
+#define LORA_RX_MODE        RXCONTIN_MODE  // RXSINGLE_MODE: solo una ventana despues de cada uplink (ACK)
 
 /* USER CODE END PD */
 
@@ -53,6 +62,13 @@ extern UART_HandleTypeDef huart2;
 LoRa myLoRa;
 uint16_t LoRa_stat=0;
 temp_sample_t s;
+track_t track;
+volatile uint8_t lora_tx_end;      // termino LoRa_transmit_IT (lo pone la ISR de DIO0)
+volatile uint8_t lora_tx_ok;
+LoRa_packet lora_rx_last;          // ultimo downlink (RSSI/SNR del enlace, para el debugger)
+#if LORA_SPI_BENCH
+LoRa_burstBench lora_bench[2];     // [0] 64 bytes, [1] 255 bytes
+#endif
 /* USER CODE END PV */
 
 /* Private function prototypes -----------------------------------------------*/
@@ -63,7 +79,11 @@ void SystemClock_Config(void);
 
 /* Private user code ---------------------------------------------------------*/
 /* USER CODE BEGIN 0 */
-
+static void lora_tx_done(LoRa *_LoRa, uint8_t ok)
+{
+	lora_tx_ok = ok;
+	lora_tx_end = 1;
+}
 /* USER CODE END 0 */
 
 /**
@@ -94,12 +114,14 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_SPI1_Init();
   MX_USART1_UART_Init();
   MX_USART2_UART_Init();
 
   /* USER CODE BEGIN 2 */
   GPS_Init();
+  GPS_SetReportInterval(REPORT_INTERVAL_MS);
   TempService_Init(&huart2, DS18B20_RES_10BIT);
 
 	 myLoRa=newLoRa();
@@ -126,8 +148,29 @@ int main(void)
 	   }
    }
 
-char transmitir[] = {'H','O','L','A'};
-char* payload ="Hola";
+#if LORA_SPI_BENCH
+   // ciclos DWT a SYSCLK, para leer con el debugger
+   LoRa_benchBurst(&myLoRa, 64, &lora_bench[0]);
+   LoRa_benchBurst(&myLoRa, 255, &lora_bench[1]);
+#endif
+   // downlinks (ACK / config): RxDone en DIO0 -> anillo de paquetes
+   LoRa_startReceive_IT(&myLoRa, LORA_RX_MODE);
+
+uint8_t payload[(UPLINK_TRACK_MAX_LEN > UPLINK_FIX_LEN) ? UPLINK_TRACK_MAX_LEN : UPLINK_FIX_LEN];  // UPLINK_FENCE_LEN <= UPLINK_FIX_LEN
+GPS_t fix = {0};
+uint32_t fix_seq = 0;
+
+Timebase_Init();
+track_init(&track, TRACK_EPS_MM, TRACK_DEADBAND_MM);
+// arranca sin cercos: el firmware no trae poligonos del campo; se cargan con Geofence_Load
+// (config de campo o downlink). Sin cercos Geofence_Check no genera eventos
+Geofence_Init();
+geofence_event_t fence_ev;
+bool tx_fence = false;         // lo que lleva la transmision en curso
+uint8_t tx_sent = 0;
+
+uint32_t t_tx = HAL_GetTick();
+uint32_t t_sent = t_tx;
 
   /* USER CODE END 2 */
 
@@ -139,9 +182,67 @@ char* payload ="Hola";
 
     /* USER CODE BEGIN 3 */
 
-	HAL_Delay(1500);
-	if(LoRa_transmit(&myLoRa, (uint8_t*)&payload, sizeof(payload), 1000)){
-		HAL_GPIO_TogglePin(GPIOC, LED_Pin);
+	// el parseo NMEA corre aca, fuera de la ISR de USART1
+	GPS_Process();
+
+	// cada fix pasa por la simplificacion; solo los puntos clave van a la cola de uplink
+	if (GPS_GetFix(&fix, &fix_seq)) {
+		// hora UTC: ancla el tick del fix (fecha + hora del receptor)
+		Timebase_OnFix(&fix);
+		if (fix.lock) {
+			track_point_t key[2];
+			uint8_t k = track_push(&track, fix.latitude, fix.longitude, fix.tick_ms, key);
+			for (uint8_t i = 0; i < k; i++) Uplink_QueuePoint(&key[i]);
+
+			// un cambio de cerco adelanta el proximo uplink a ya
+			if (Geofence_Check(fix.latitude, fix.longitude, fix.tick_ms)) t_tx = HAL_GetTick() - REPORT_INTERVAL_MS;
+		}
+	}
+
+	// el GPS se durmio (ON/OFF o backup): el ultimo punto de la ventana sale ya,
+	// sin esperar al proximo fix ni a TRACK_MAX_HOLD_MS
+	if (GPS_TakeSleep()) {
+		track_point_t last;
+		if (track_flush(&track, &last)) Uplink_QueuePoint(&last);
+	}
+
+	// downlinks recibidos por la ISR de DIO0
+	const LoRa_rxSlot *rx;
+	while ((rx = LoRa_rxPeek(&myLoRa)) != NULL) {
+		lora_rx_last = rx->pkt;
+		// aca se decodifican ACK / config (rx->data, rx->pkt.length)
+		LoRa_rxRelease(&myLoRa);
+	}
+
+	// fin de la transmision (TxDone o timeout); el payload queda tomado hasta aca
+	if (lora_tx_end) {
+		lora_tx_end = 0;
+		if (lora_tx_ok) {
+			if (tx_fence) Geofence_EventSent(&fence_ev);
+			Uplink_Release(tx_sent);
+			t_sent = t_tx;
+			HAL_GPIO_TogglePin(GPIOC, LED_Pin);
+		}
+	}
+
+	// la radio transmite sola: el lazo sigue con el GPS mientras tanto.
+	// Si termino despues del chequeo de arriba, primero se atiende ese resultado
+	// (tx_fence / tx_sent son de esa trama) y recien en la vuelta siguiente se arranca otra
+	if (!lora_tx_end && !LoRa_txBusy(&myLoRa) && (HAL_GetTick() - t_tx) >= REPORT_INTERVAL_MS) {
+		t_tx = HAL_GetTick();
+		uint8_t len = 0;
+		tx_sent = 0;
+		tx_fence = Geofence_PendingEvent(&fence_ev);
+		if (tx_fence) {
+			len = Uplink_EncodeFence(&fence_ev, payload, sizeof(payload));
+		} else if (Uplink_Pending() >= UPLINK_TRACK_BATCH ||
+		    (Uplink_Pending() && (t_tx - Uplink_OldestMs()) >= TRACK_BATCH_MS)) {
+			len = Uplink_EncodeTrack(payload, sizeof(payload), &tx_sent);
+		} else if ((t_tx - t_sent) >= HEARTBEAT_MS) {
+			// la trama lleva el ultimo fix publicado (o lock = 0)
+			len = Uplink_EncodeFix(&fix, payload, sizeof(payload));
+		}
+		if (len) LoRa_transmit_IT(&myLoRa, payload, len, 1000, lora_tx_done);
 	}
 	//TempService_ReadOnce_Blocking(&s);
 
@@ -189,18 +290,49 @@ void SystemClock_Config(void)
 
 /* USER CODE BEGIN 4 */
 /* USER CODE BEGIN 0 */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+{
+	// DMA circular: llega en HT, TC o IDLE; Size = posicion de escritura del DMA
+	if(huart == &huart1) GPS_UART_CallBack(Size);
+}
+
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
+{
+	// fin de un frame UBX por DMA: encadena el siguiente de la configuracion
+	if(huart == &huart1) GPS_UART_TxCallBack();
+}
+
+void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
-	if(huart == &huart1) GPS_UART_CallBack();
+	if(huart == &huart1) GPS_UART_ErrorCallBack();
 }
 
 
+// Fin de las rafagas DMA de SPI1 (FIFO del SX1278): suelta NSS en LoRa_SPI_CallBack
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+	if(hspi == &hspi1) LoRa_SPI_CallBack(&myLoRa, 1);
+}
+
+// HAL_SPI_Receive_DMA en master full-duplex termina por SPI_DMAReceiveCplt -> RxCpltCallback
+void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
+{
+	if(hspi == &hspi1) LoRa_SPI_CallBack(&myLoRa, 1);
+}
+
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi)
+{
+	if(hspi == &hspi1) LoRa_SPI_CallBack(&myLoRa, 0);
+}
+
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin){
-	//si se recibe una interrupcion del pin dio0, es que llego un mensaje
-	//lo guardo en el buffer y activo la flag para decodificarlo.
+#ifdef GPS_PPS_Pin
+	// timepulse del receptor (si esta cableado): borde exacto del segundo UTC
+	if (GPIO_Pin == GPS_PPS_Pin) Timebase_OnPulse(HAL_GetTick());
+#endif
 	if (GPIO_Pin==DIO0_Pin){
-		//LoRa_receive(&myLoRa,RxBuffer,sizeof(Mytrama));
-		//FlagRecibir=1;
+		// RxDone (paquete al anillo) o TxDone de LoRa_transmit_IT (o su timeout, disparado desde SysTick)
+		LoRa_DIO0_CallBack(&myLoRa);
 	}
 
 }
@@ -6,6 +6,7 @@
  */
 
 #include "service_temp.h"
+#include "timebase.h"
 
 // ---- Estado privado del módulo
 static ow_uart_t   s_ow;
@@ -100,6 +101,7 @@ bool TempService_ReadOnce_Blocking(temp_sample_t *out)
     if (!out) return false;
 
     out->t_ms = HAL_GetTick();
+    out->epoch_ms = Timebase_TickToEpochMs(out->t_ms);
 
     int32_t t_mC = 0;
     temp_status_t st = temp_read_once_blocking(&t_mC);
@@ -119,6 +121,7 @@ void TempService_Init(UART_HandleTypeDef *huart, ds18b20_resolution_t res)
     // Limpiar último resultado
     for (uint32_t i = 0; i < TEMP_SAMPLE_COUNT; i++) {
         s_last.samples[i].t_ms = 0;
+        s_last.samples[i].epoch_ms = 0;
         s_last.samples[i].temp_mC = 0;
         s_last.samples[i].status = TEMP_ST_UNKNOWN;
     }
@@ -153,6 +156,7 @@ bool TempService_ReadAvg3_Blocking(temp_avg3_result_t *out)
 
     for (uint32_t i = 0; i < TEMP_SAMPLE_COUNT; i++) {
         r.samples[i].t_ms = HAL_GetTick();
+        r.samples[i].epoch_ms = Timebase_TickToEpochMs(r.samples[i].t_ms);
 
         int32_t t_mC = 0;
         temp_status_t st = temp_read_once_blocking(&t_mC);
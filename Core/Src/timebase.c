@@ -0,0 +1,125 @@
+/*
+ * timebase.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#include "stm32f1xx_hal.h"
+#include "timebase.h"
+
+static bool     tb_valid;
+static uint64_t tb_epoch_ms;    // ancla actual: epoch en tb_tick
+static uint32_t tb_tick;
+static uint64_t tb_ref_epoch;   // ancla vieja para medir la deriva (al menos TIMEBASE_DRIFT_MIN_MS atras)
+static uint32_t tb_ref_tick;
+static int32_t  tb_drift_ppm;
+static bool     tb_drift_ok;    // ya hubo una medicion de deriva (despues se promedia)
+
+static volatile uint32_t tb_pulse_tick;
+static volatile bool     tb_pulse;
+
+static timebase_stats_t tb_stats;
+
+// dias desde 1970-01-01 (calendario gregoriano, solo enteros)
+static int32_t tb_days_from_civil(int32_t y, uint32_t m, uint32_t d){
+	y -= (m <= 2);
+	const int32_t era = y / 400;
+	const uint32_t yoe = (uint32_t)(y - era * 400);
+	const uint32_t doy = (153u * ((m > 2) ? m - 3u : m + 9u) + 2u) / 5u + d - 1u;
+	const uint32_t doe = yoe * 365u + yoe / 4u - yoe / 100u + doy;
+	return era * 146097 + (int32_t)doe - 719468;
+}
+
+// date ddmmyy + utc_time hhmmss.sss x1000 -> epoch ms (0 si no hay fecha valida)
+static uint64_t tb_fix_epoch_ms(const GPS_t *fix){
+	uint32_t date = (uint32_t)fix->date;
+	uint32_t dd = date / 10000u, mo = date / 100u % 100u, yy = date % 100u;
+	uint32_t ms = fix->utc_time % 1000u, hms = fix->utc_time / 1000u;
+	uint32_t hh = hms / 10000u, mi = hms / 100u % 100u, ss = hms % 100u;
+
+	if (dd < 1 || dd > 31 || mo < 1 || mo > 12 || hh > 23 || mi > 59 || ss > 60) return 0;
+	int32_t days = tb_days_from_civil(2000 + (int32_t)yy, mo, dd);
+	return (((uint64_t)days * 24u + hh) * 60u + mi) * 60000u + ss * 1000u + ms;
+}
+
+void Timebase_Init(void){
+	tb_valid = false;
+	tb_drift_ppm = 0;
+	tb_drift_ok = false;
+	tb_pulse = false;
+	tb_stats = (timebase_stats_t){ 0 };
+}
+
+// Epoch de un tick con la deriva corregida; vale tambien para ticks un poco anteriores al ancla
+static uint64_t tb_project(uint32_t tick){
+	int64_t d = (int32_t)(tick - tb_tick);
+	return tb_epoch_ms + d * 1000000 / (1000000 + tb_drift_ppm);
+}
+
+void Timebase_OnFix(const GPS_t *fix){
+	if (fix->date == 0 || (fix->lock == 0 && fix->rmc_status != 'A')) return;
+
+	uint64_t epoch = tb_fix_epoch_ms(fix);
+	if (epoch == 0) return;
+
+	uint32_t tick = fix->tick_ms - TIMEBASE_GPS_LATENCY_MS;
+	// el pulso marca el borde del segundo que este fix describe
+	if (tb_pulse && (fix->tick_ms - tb_pulse_tick) < 1000u && (epoch % 1000u) == 0) {
+		tick = tb_pulse_tick;
+		tb_stats.pulse_syncs++;
+	}
+	tb_pulse = false;
+
+	if (tb_valid) {
+		int64_t err = (int64_t)tb_project(tick) - (int64_t)epoch;
+		if (err > INT32_MAX) err = INT32_MAX;
+		if (err < -INT32_MAX) err = -INT32_MAX;
+		tb_stats.last_error_ms = (int32_t)err;
+		int32_t abs_err = (err < 0) ? (int32_t)-err : (int32_t)err;
+		if (abs_err > tb_stats.max_error_ms) tb_stats.max_error_ms = abs_err;
+
+		// deriva: ticks contados contra ms UTC transcurridos sobre una base larga
+		uint64_t utc = epoch - tb_ref_epoch;
+		if (epoch > tb_ref_epoch && utc >= TIMEBASE_DRIFT_MIN_MS) {
+			int64_t ticks = (int64_t)(uint32_t)(tick - tb_ref_tick);
+			int64_t ppm = (ticks - (int64_t)utc) * 1000000 / (int64_t)utc;
+			if (ppm <= TIMEBASE_DRIFT_MAX_PPM && ppm >= -TIMEBASE_DRIFT_MAX_PPM) {
+				tb_drift_ppm = tb_drift_ok ? (3 * tb_drift_ppm + (int32_t)ppm) / 4 : (int32_t)ppm;
+				tb_drift_ok = true;
+				tb_stats.drift_ppm = tb_drift_ppm;
+			}
+			tb_ref_epoch = epoch;
+			tb_ref_tick = tick;
+		} else if (epoch < tb_ref_epoch) {
+			tb_ref_epoch = epoch;           // la hora del GPS fue para atras: reempezar la medicion
+			tb_ref_tick = tick;
+		}
+	} else {
+		tb_ref_epoch = epoch;
+		tb_ref_tick = tick;
+	}
+
+	tb_epoch_ms = epoch;
+	tb_tick = tick;
+	tb_valid = true;
+	tb_stats.valid = true;
+	tb_stats.syncs++;
+}
+
+void Timebase_OnPulse(uint32_t tick){
+	tb_pulse_tick = tick;
+	tb_pulse = true;
+}
+
+uint64_t Timebase_TickToEpochMs(uint32_t tick){
+	return tb_valid ? tb_project(tick) : 0;
+}
+
+uint64_t Timebase_NowEpochMs(void){
+	return Timebase_TickToEpochMs(HAL_GetTick());
+}
+
+timebase_stats_t Timebase_GetStats(void){
+	return tb_stats;
+}
@@ -0,0 +1,143 @@
+/*
+ * track.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#include "track.h"
+#include "gps_filter.h"
+
+// Las cuentas van en un plano local alrededor del ancla, en 1e-7 grados de latitud (11.132 mm):
+// y = dlat, x = dlon * cos(lat_ancla). Con TRACK_SPAN_MAX los productos entran en int64.
+#define TRACK_UNIT_PER_MM_Q16   5887    // 65536 / 11.132
+
+static int32_t track_mm_to_units(uint32_t mm){
+	return (int32_t)(((uint64_t)mm * TRACK_UNIT_PER_MM_Q16) >> 16);
+}
+
+static void track_local(const track_t *t, const track_point_t *p, int64_t *x, int64_t *y){
+	*y = (int64_t)p->lat - t->anchor.lat;
+	*x = (((int64_t)p->lon - t->anchor.lon) * t->cos_q15) >> 15;
+}
+
+// raiz entera (piso), numero fijo de iteraciones
+static int64_t track_isqrt(uint64_t v){
+	uint64_t r = 0, bit = 1ull << 62;
+
+	while (bit > v) bit >>= 2;
+	while (bit) {
+		if (v >= r + bit) {
+			v -= r + bit;
+			r = (r >> 1) + bit;
+		} else {
+			r >>= 1;
+		}
+		bit >>= 2;
+	}
+	return (int64_t)r;
+}
+
+static void track_set_anchor(track_t *t, const track_point_t *p){
+	t->anchor = *p;
+	t->cos_q15 = gps_filter_cos_q15(p->lat);
+	t->n = 0;
+}
+
+// true si todos los puntos de la ventana quedan a menos de eps del segmento ancla -> (dx, dy)
+static bool track_segment_ok(const track_t *t, int64_t dx, int64_t dy){
+	const int64_t eps = t->eps;
+	const int64_t len2 = dx * dx + dy * dy;
+	const int64_t len = track_isqrt((uint64_t)len2);
+
+	for (uint8_t i = 0; i < t->n; i++) {
+		int64_t cx, cy;
+		track_local(t, &t->win[i], &cx, &cy);
+
+		int64_t dot = cx * dx + cy * dy;
+		if (dot <= 0 || len2 == 0) {
+			// antes del ancla (o segmento nulo): distancia al ancla
+			if (cx * cx + cy * cy > eps * eps) return false;
+		} else if (dot >= len2) {
+			// mas alla del fix nuevo: distancia al fix
+			int64_t ex = cx - dx, ey = cy - dy;
+			if (ex * ex + ey * ey > eps * eps) return false;
+		} else {
+			// distancia perpendicular = |cruz| / len
+			int64_t cross = cx * dy - cy * dx;
+			if (cross < 0) cross = -cross;
+			if (cross > eps * len) return false;
+		}
+	}
+	return true;
+}
+
+void track_init(track_t *t, uint32_t eps_mm, uint32_t deadband_mm){
+	t->init = false;
+	t->n = 0;
+	t->eps = track_mm_to_units(eps_mm);
+	t->deadband = track_mm_to_units(deadband_mm);
+	t->points_in = 0;
+	t->points_out = 0;
+	t->deadband_drops = 0;
+}
+
+uint8_t track_push(track_t *t, gps_coord_t lat, gps_coord_t lon, uint32_t t_ms, track_point_t out[2]){
+	const track_point_t p = { lat, lon, t_ms };
+	uint8_t k = 0;
+	int64_t dx, dy;
+
+	t->points_in++;
+	if (!t->init) {
+		t->init = true;
+		track_set_anchor(t, &p);
+		out[k++] = p;
+		t->points_out += k;
+		return k;
+	}
+
+	track_local(t, &p, &dx, &dy);
+	if (dx > TRACK_SPAN_MAX || dx < -TRACK_SPAN_MAX || dy > TRACK_SPAN_MAX || dy < -TRACK_SPAN_MAX) {
+		// salto enorme (reinicio del receptor): se cierra lo pendiente y se arranca en el fix
+		if (t->n) out[k++] = t->win[t->n - 1];
+		out[k++] = p;
+		track_set_anchor(t, &p);
+		t->points_out += k;
+		return k;
+	}
+
+	// banda muerta contra el ultimo punto guardado (o el ancla)
+	int64_t lx = 0, ly = 0;
+	if (t->n) track_local(t, &t->win[t->n - 1], &lx, &ly);
+	lx -= dx;
+	ly -= dy;
+	bool hold = (t_ms - t->anchor.t_ms) >= TRACK_MAX_HOLD_MS;
+	if (lx * lx + ly * ly < (int64_t)t->deadband * t->deadband) {
+		t->deadband_drops++;
+		if (!hold) return 0;
+	}
+
+	if (!track_segment_ok(t, dx, dy)) {
+		// el fix anterior es el ultimo que cumplia: pasa a ser el ancla
+		out[k++] = t->win[t->n - 1];
+		track_set_anchor(t, &out[0]);
+		hold = (t_ms - t->anchor.t_ms) >= TRACK_MAX_HOLD_MS;
+	}
+
+	if (hold || t->n == TRACK_WINDOW) {
+		out[k++] = p;
+		track_set_anchor(t, &p);
+	} else {
+		t->win[t->n++] = p;
+	}
+	t->points_out += k;
+	return k;
+}
+
+bool track_flush(track_t *t, track_point_t *out){
+	if (!t->init || t->n == 0) return false;
+	*out = t->win[t->n - 1];
+	track_set_anchor(t, out);
+	t->points_out++;
+	return true;
+}
@@ -6,6 +6,7 @@
  */
 
 #include "ubx.h"
+#include <string.h>
 
 /*
  * ubx.c
@@ -15,69 +16,56 @@
 
  */
 
+// Todos los frames se arman con UBX_DEFINE (ubx_frame.h): sync, largo y checksum salen
+// del preprocesador, y un payload que no coincide con UBX_LEN_* no compila.
+
 //configurar el rate a 5hz
-const uint8_t UBX_CFGRATE_5HZ[10] = {
-    0x06, 0x08, 0x06, 0x00,
+UBX_DEFINE(UBX_CFGRATE_5HZ, UBX_LEN_CFG_RATE, UBX_CLASS_CFG, UBX_ID_CFG_RATE,
     0xC8, 0x00, // measRate = 200 ms
-    0x01, 0x00, // navRate = 1 (en u-blox 6 no se cambia) :contentReference[oaicite:8]{index=8}
+    0x01, 0x00, // navRate = 1 (en u-blox 6 no se cambia)
     0x01, 0x00  // timeRef = 1 (GPS time)  (si querés UTC, poné 0x00 0x00)
-};
+);
+
 
+// CFG-MSG: msgClass, msgID, rates por puerto (DDC, UART1, UART2, USB, SPI, reservado)
+#define UBX_CFGMSG_UART1(name, cls, id, rate) \
+    UBX_DEFINE(name, UBX_LEN_CFG_MSG, UBX_CLASS_CFG, UBX_ID_CFG_MSG, (cls), (id), 0x00, (rate), 0x00, 0x00, 0x00, 0x00)
 
 //encender los mensajes de GGA
 // CFG-MSG: msgClass=F0, msgID=00 (GGA), rates: UART1=1, resto=0
- const uint8_t UBX_CFGMSG_GGA_UART1_ON_BODY[12] = {
-    0x06, 0x01, 0x08, 0x00,
-    0xF0, 0x00,
-    0x00, 0x01, 0x00, 0x00, 0x00, 0x00
-};
-
+UBX_CFGMSG_UART1(UBX_CFGMSG_GGA_UART1_ON, 0xF0, 0x00, 1);
 
 //encender los mensajes de RMC
 // CFG-MSG: msgClass=F0, msgID=04 (RMC), rates: UART1=1, resto=0
- const uint8_t UBX_CFGMSG_RMC_UART1_ON_BODY[12] = {
-    0x06, 0x01, 0x08, 0x00,
-    0xF0, 0x04,
-    0x00, 0x01, 0x00, 0x00, 0x00, 0x00
-};
+UBX_CFGMSG_UART1(UBX_CFGMSG_RMC_UART1_ON, 0xF0, 0x04, 1);
 
+//apagar GGA y RMC (modo binario UBX)
+UBX_CFGMSG_UART1(UBX_CFGMSG_GGA_UART1_OFF, 0xF0, 0x00, 0);
+UBX_CFGMSG_UART1(UBX_CFGMSG_RMC_UART1_OFF, 0xF0, 0x04, 0);
 
+//apagar el resto de las sentencias NMEA
+UBX_CFGMSG_UART1(UBX_CFGMSG_GLL_UART1_OFF, 0xF0, 0x01, 0);
+UBX_CFGMSG_UART1(UBX_CFGMSG_GSA_UART1_OFF, 0xF0, 0x02, 0);
+UBX_CFGMSG_UART1(UBX_CFGMSG_GSV_UART1_OFF, 0xF0, 0x03, 0);
+UBX_CFGMSG_UART1(UBX_CFGMSG_VTG_UART1_OFF, 0xF0, 0x05, 0);
 
- const uint8_t UBX_CFGMSG_GLL_UART1_OFF_BODY[12] = {
-    0x06, 0x01, 0x08, 0x00,
-    0xF0, 0x01,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+//Modo binario: NAV-PVT trae todo el fix en un solo mensaje (100 bytes por epoca)
+UBX_CFGMSG_UART1(UBX_CFGMSG_NAVPVT_UART1_ON, UBX_CLASS_NAV, UBX_ID_NAV_PVT, 1);
 
- const uint8_t UBX_CFGMSG_GSA_UART1_OFF_BODY[12] = {
-    0x06, 0x01, 0x08, 0x00,
-    0xF0, 0x02,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-
- const uint8_t UBX_CFGMSG_GSV_UART1_OFF_BODY[12] = {
-    0x06, 0x01, 0x08, 0x00,
-    0xF0, 0x03,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-
- const uint8_t UBX_CFGMSG_VTG_UART1_OFF_BODY[12] = {
-    0x06, 0x01, 0x08, 0x00,
-    0xF0, 0x05,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
+//u-blox 6 no tiene NAV-PVT: POSLLH + VELNED + TIMEUTC + STATUS (132 bytes por epoca)
+UBX_CFGMSG_UART1(UBX_CFGMSG_NAVPOSLLH_UART1_ON,  UBX_CLASS_NAV, UBX_ID_NAV_POSLLH, 1);
+UBX_CFGMSG_UART1(UBX_CFGMSG_NAVVELNED_UART1_ON,  UBX_CLASS_NAV, UBX_ID_NAV_VELNED, 1);
+UBX_CFGMSG_UART1(UBX_CFGMSG_NAVTIMEUTC_UART1_ON, UBX_CLASS_NAV, UBX_ID_NAV_TIMEUTC, 1);
+UBX_CFGMSG_UART1(UBX_CFGMSG_NAVSTATUS_UART1_ON,  UBX_CLASS_NAV, UBX_ID_NAV_STATUS, 1);
 
 
 //Configuracion de modo de navegacion, cambio a modo Pedestrian
 //seteo de staticHold (no dar mediciones diferentes si no se tiene movimientos de mas de 20cm/s)
  // UBX-CFG-NAV5: dynModel=Pedestrian + staticHoldThresh=20 cm/s
-const uint8_t UBX_CFGNAV5_CATTLE_BODY[40] = {
-     0x06, 0x24, 0x24, 0x00,
-
+UBX_DEFINE(UBX_CFGNAV5_CATTLE, UBX_LEN_CFG_NAV5, UBX_CLASS_CFG, UBX_ID_CFG_NAV5,
      0x41, 0x00,               // mask = 0x0041 -> dynModel + staticHoldThresh
      0x03,                     // dynModel = 3 (Pedestrian)
      0x00,                     // fixMode (no aplicado)
-
      0x00, 0x00, 0x00, 0x00,
      0x00, 0x00, 0x00, 0x00,
      0x00,
@@ -86,34 +74,34 @@ const uint8_t UBX_CFGNAV5_CATTLE_BODY[40] = {
      0x00, 0x00,
      0x00, 0x00,
      0x00, 0x00,
-
      0x3C,                     // staticHoldThresh = 20 cm/s
      0x00,
-
      0x00, 0x00, 0x00, 0x00,
      0x00, 0x00, 0x00, 0x00,
      0x00, 0x00, 0x00, 0x00
- };
+ );
 
 
 //Guardar toda las configuraciones para que persistan en memoria BBR
- const uint8_t UBX_CFGCFG_SAVE_ALL_BBR[17] = {
-    0x06, 0x09, 0x0D, 0x00,          // class, id, len=13
+UBX_DEFINE(UBX_CFGCFG_SAVE_ALL_BBR, UBX_LEN_CFG_CFG, UBX_CLASS_CFG, UBX_ID_CFG_CFG,
     0x00, 0x00, 0x00, 0x00,          // clearMask = 0
     0x1F, 0x06, 0x00, 0x00,          // saveMask  = 0x061F (subsec 0,1,2,3,4,9,10)
     0x00, 0x00, 0x00, 0x00,          // loadMask  = 0
     0x01                              // deviceMask = devBBR
-};
-
+);
 
  //Volver a los valores de fabrica con los que viene el modulo
- const uint8_t UBX_CFGCFG_FACTORY_DEFAULTS_BBR[17] = {
-     0x06, 0x09, 0x0D, 0x00,          // len=13
+UBX_DEFINE(UBX_CFGCFG_FACTORY_DEFAULTS_BBR, UBX_LEN_CFG_CFG, UBX_CLASS_CFG, UBX_ID_CFG_CFG,
      0x1F, 0x06, 0x00, 0x00,          // clearMask = 0x061F  (restaura defaults en permanente)
      0x00, 0x00, 0x00, 0x00,          // saveMask  = 0
      0x1F, 0x06, 0x00, 0x00,          // loadMask  = 0x061F  (carga defaults a current)
      0x01                              // deviceMask = devBBR
- };
+ );
+
+// Poll de CFG-PRT para UART1 (el receptor contesta CFG-PRT + ACK)
+const uint8_t UBX_POLL_CFGPRT_UART1[] = UBX_FRAME(UBX_CLASS_CFG, UBX_ID_CFG_PRT,
+    0x01                      // portID = 1 (UART1)
+);
 
 //TODO Borrar esta variable, es solo para debug,
  //debe ser una logica posterior de manejo de errores
@@ -132,22 +120,33 @@ static void ubx_checksum(const uint8_t *data, uint16_t len, uint8_t *ck_a, uint8
 
 
 
- HAL_StatusTypeDef ubx_send_body(UART_HandleTypeDef *huart,
-                                       const uint8_t *body, uint16_t body_len,
-                                       uint32_t timeout_ms)
-{
-    uint8_t sync[2] = {0xB5, 0x62};
-    uint8_t ck_a, ck_b;
-    ubx_checksum(body, body_len, &ck_a, &ck_b);
+ uint16_t ubx_frame_build(uint8_t *out, uint16_t size, uint8_t cls, uint8_t id,
+                          const uint8_t *payload, uint16_t payload_len)
+ {
+     if (out == NULL || size < UBX_FRAME_SIZE(payload_len)) return 0;
+     if (payload_len != 0 && payload == NULL) return 0;
+
+     out[0] = 0xB5;
+     out[1] = 0x62;
+     out[2] = cls;
+     out[3] = id;
+     out[4] = (uint8_t)(payload_len);
+     out[5] = (uint8_t)(payload_len >> 8);
+     if (payload_len != 0) memcpy(&out[6], payload, payload_len);
+     ubx_checksum(&out[2], payload_len + 4, &out[6 + payload_len], &out[7 + payload_len]);
+     return UBX_FRAME_SIZE(payload_len);
+ }
 
-    if (HAL_UART_Transmit(huart, sync, 2, timeout_ms) != HAL_OK) return UBX_ERR_TX;
-    if (HAL_UART_Transmit(huart, (uint8_t*)body, body_len, timeout_ms) != HAL_OK) return UBX_ERR_TX;
+ ubx_status_t ubx_send_frame(UART_HandleTypeDef *huart,
+                             const uint8_t *frame, uint16_t frame_len,
+                             uint32_t timeout_ms)
+ {
+     // una sola transmision: sync + header + payload + checksum ya vienen en el frame
+     if (HAL_UART_Transmit(huart, (uint8_t*)frame, frame_len, timeout_ms) != HAL_OK) return UBX_ERR_TX;
+     return UBX_OK;
+ }
 
-    uint8_t ck[2] = {ck_a, ck_b};
-    if (HAL_UART_Transmit(huart, ck, 2, timeout_ms) != HAL_OK) return UBX_ERR_TX;
 
-     return UBX_OK;
-}
 
 
 
@@ -204,6 +203,87 @@ static ubx_status_t ubx_wait_ack(UART_HandleTypeDef *huart,
 }
 
 
+ uint16_t ubx_build_cfg_rate(uint8_t *out, uint16_t size, uint16_t meas_ms)
+ {
+     uint8_t payload[UBX_LEN_CFG_RATE] = {
+         (uint8_t)(meas_ms), (uint8_t)(meas_ms >> 8),  // measRate
+         0x01, 0x00,               // navRate = 1
+         0x01, 0x00                // timeRef = 1 (GPS time)
+     };
+     return ubx_frame_build(out, size, UBX_CLASS_CFG, UBX_ID_CFG_RATE, payload, sizeof(payload));
+ }
+
+ uint16_t ubx_build_cfg_pm2(uint8_t *out, uint16_t size, uint32_t flags,
+                            uint32_t update_ms, uint32_t search_ms)
+ {
+     uint8_t payload[UBX_LEN_CFG_PM2] = {
+         0x01,                     // version
+         0x00, 0x00, 0x00,         // reserved
+         (uint8_t)(flags), (uint8_t)(flags >> 8), (uint8_t)(flags >> 16), (uint8_t)(flags >> 24),
+         (uint8_t)(update_ms), (uint8_t)(update_ms >> 8), (uint8_t)(update_ms >> 16), (uint8_t)(update_ms >> 24),
+         (uint8_t)(search_ms), (uint8_t)(search_ms >> 8), (uint8_t)(search_ms >> 16), (uint8_t)(search_ms >> 24),
+         0x00, 0x00, 0x00, 0x00,   // gridOffset
+         0x00, 0x00,               // onTime = 0: se apaga apenas tiene fix
+         0x00, 0x00                // minAcqTime
+                                   // resto reservado en 0
+     };
+     return ubx_frame_build(out, size, UBX_CLASS_CFG, UBX_ID_CFG_PM2, payload, sizeof(payload));
+ }
+
+ uint16_t ubx_build_cfg_rxm(uint8_t *out, uint16_t size, bool power_save)
+ {
+     uint8_t payload[UBX_LEN_CFG_RXM] = {
+         0x08,                     // reserved (valor fijo segun el protocolo)
+         power_save ? 0x01 : 0x00  // lpMode
+     };
+     return ubx_frame_build(out, size, UBX_CLASS_CFG, UBX_ID_CFG_RXM, payload, sizeof(payload));
+ }
+
+ uint16_t ubx_build_rxm_pmreq(uint8_t *out, uint16_t size, uint32_t duration_ms)
+ {
+     uint8_t payload[UBX_LEN_RXM_PMREQ] = {
+         (uint8_t)(duration_ms), (uint8_t)(duration_ms >> 8), (uint8_t)(duration_ms >> 16), (uint8_t)(duration_ms >> 24),
+         0x02, 0x00, 0x00, 0x00    // flags: backup
+     };
+     return ubx_frame_build(out, size, UBX_CLASS_RXM, UBX_ID_RXM_PMREQ, payload, sizeof(payload));
+ }
+
+ uint16_t ubx_build_cfg_prt_uart1(uint8_t *out, uint16_t size, uint32_t baud)
+ {
+     uint8_t payload[UBX_LEN_CFG_PRT] = {
+         0x01,                     // portID = 1 (UART1)
+         0x00,                     // reserved
+         0x00, 0x00,               // txReady deshabilitado
+         0xD0, 0x08, 0x00, 0x00,   // mode = 8N1
+         (uint8_t)(baud), (uint8_t)(baud >> 8), (uint8_t)(baud >> 16), (uint8_t)(baud >> 24),
+         0x03, 0x00,               // inProtoMask  = UBX + NMEA
+         0x03, 0x00,               // outProtoMask = UBX + NMEA
+         0x00, 0x00,               // flags
+         0x00, 0x00                // reserved
+     };
+     return ubx_frame_build(out, size, UBX_CLASS_CFG, UBX_ID_CFG_PRT, payload, sizeof(payload));
+ }
+
+ ubx_status_t ubx_set_uart1_baud(UART_HandleTypeDef *huart, uint32_t baud, uint32_t tx_timeout_ms)
+ {
+     uint8_t frame[UBX_FRAME_SIZE(UBX_LEN_CFG_PRT)];
+     uint16_t len = ubx_build_cfg_prt_uart1(frame, sizeof(frame), baud);
+
+     if (ubx_send_frame(huart, frame, len, tx_timeout_ms) != UBX_OK) return UBX_ERR_TX;
+
+     // esperar que salga el ultimo bit antes de que alguien toque el BRR
+     uint32_t t0 = HAL_GetTick();
+     while (__HAL_UART_GET_FLAG(huart, UART_FLAG_TC) == RESET) {
+         if ((HAL_GetTick() - t0) > tx_timeout_ms) return UBX_ERR_TX;
+     }
+     return UBX_OK;
+ }
+
+ ubx_status_t ubx_probe(UART_HandleTypeDef *huart, uint32_t ack_timeout_ms)
+ {
+     return ubx_send_frame_wait_ack(huart, UBX_POLL_CFGPRT_UART1, sizeof(UBX_POLL_CFGPRT_UART1),
+                                    50, ack_timeout_ms);
+ }
 
  void ubx_uart_recover(UART_HandleTypeDef *huart, uint32_t drain_ms)
  {
@@ -227,7 +307,7 @@ static ubx_status_t ubx_wait_ack(UART_HandleTypeDef *huart,
 
  // --- Envío con reintentos (solo reintenta transitorios)
  ubx_status_t gps_send_cfg_retry(UART_HandleTypeDef *huart,
-                                       const uint8_t *body, uint16_t len,
+                                       const uint8_t *frame, uint16_t len,
                                        uint8_t retries,
                                        uint32_t tx_to, uint32_t ack_to)
  {
@@ -241,7 +321,7 @@ static ubx_status_t ubx_wait_ack(UART_HandleTypeDef *huart,
              HAL_Delay(80);                   // backoff corto
          }
 
-         ubx_status_t r = ubx_send_body_wait_ack(huart, body, len, tx_to, ack_to);
+         ubx_status_t r = ubx_send_frame_wait_ack(huart, frame, len, tx_to, ack_to);
          last = r;
 
          if (r == UBX_OK) return UBX_OK;
@@ -268,21 +348,199 @@ static ubx_status_t ubx_wait_ack(UART_HandleTypeDef *huart,
  }
 
 
- ubx_status_t ubx_send_body_wait_ack(UART_HandleTypeDef *huart,
-                                                const uint8_t *body, uint16_t body_len,
-                                                uint32_t tx_timeout_ms,
-                                                uint32_t ack_timeout_ms)
+ ubx_status_t ubx_send_frame_wait_ack(UART_HandleTypeDef *huart,
+                                      const uint8_t *frame, uint16_t frame_len,
+                                      uint32_t tx_timeout_ms,
+                                      uint32_t ack_timeout_ms)
  {
- 	 if (body == NULL) return UBX_ERR_PARAM;
- 	    if (body_len < 4) return UBX_ERR_PARAM; // mínimo: cls,id,lenL,lenH
+     // el largo de los frames UBX_FRAME ya se verifico al compilar
+     if (frame == NULL || frame_len < UBX_FRAME_SIZE(0)) return UBX_ERR_PARAM;
+
+     ubx_status_t tx = ubx_send_frame(huart, frame, frame_len, tx_timeout_ms);
+     if (tx != UBX_OK) return tx;
+
+     return ubx_wait_ack(huart, frame[2], frame[3], ack_timeout_ms);
+ }
+
 
- 	    // Validación fuerte: LEN declarado vs body_len real
- 	    uint16_t declared = (uint16_t)body[2] | ((uint16_t)body[3] << 8);
- 	    if (body_len != (uint16_t)(4 + declared)) return UBX_ERR_PARAM;
 
- 	    ubx_status_t tx = ubx_send_body(huart, body, body_len, tx_timeout_ms);
- 	    if (tx != UBX_OK) return tx;
+ // ---- Motor de configuracion no bloqueante ----
 
- 	    return ubx_wait_ack(huart, body[0], body[1], ack_timeout_ms);
+ #define UBX_JOB_QUEUED   0   // esperando turno (o el backoff de un reintento)
+ #define UBX_JOB_INFLIGHT 1   // enviado, esperando ACK
+
+ typedef struct {
+     const uint8_t *frame;    // frame completo (flash o buffer static)
+     uint16_t len;
+     uint8_t  state;
+     uint8_t  tries_left;
+     uint32_t ack_timeout;
+     uint32_t t_due;          // QUEUED: no antes de; INFLIGHT: vence el ACK
+     ubx_frame_cb_t cb;       // solo polls: recibe la respuesta
+ } ubx_cfg_job_t;
+
+ // El motor se usa desde main (submit y timeouts en GPS_Process) y desde las ISR de USART1
+ // (ACK / respuestas en el framer de RX, siguiente envio en TxCplt): cada entrada corre
+ // con las IRQ apagadas. Guarda PRIMASK, asi se puede anidar (el cb de un poll hace submit).
+ static ubx_cfg_job_t ubx_jobs[UBX_CFG_QUEUE_LEN];
+ static volatile uint8_t ubx_jobs_head = 0;  // proximo libre
+ static volatile uint8_t ubx_jobs_tail = 0;  // mas viejo sin terminar
+ static bool    ubx_job_done[UBX_CFG_QUEUE_LEN];
+ static uint8_t ubx_cfg_errors = 0;
+ static ubx_cfg_stats_t ubx_cfg_stats;
+
+ static inline uint32_t ubx_lock(void)
+ {
+     uint32_t primask = __get_PRIMASK();
+     __disable_irq();
+     return primask;
+ }
+
+ static inline void ubx_unlock(uint32_t primask)
+ {
+     __set_PRIMASK(primask);
+ }
+
+ ubx_status_t ubx_cfg_submit(const uint8_t *frame, uint16_t frame_len,
+                             uint8_t retries, uint32_t ack_timeout_ms)
+ {
+     return ubx_poll_submit(frame, frame_len, retries, ack_timeout_ms, NULL);
+ }
+
+ ubx_status_t ubx_poll_submit(const uint8_t *frame, uint16_t frame_len,
+                              uint8_t retries, uint32_t ack_timeout_ms, ubx_frame_cb_t cb)
+ {
+     if (frame == NULL || frame_len < UBX_FRAME_SIZE(0)) return UBX_ERR_PARAM;
+     uint32_t pm = ubx_lock();
+     if ((uint8_t)(ubx_jobs_head - ubx_jobs_tail) >= UBX_CFG_QUEUE_LEN) {
+         ubx_unlock(pm);
+         return UBX_ERR_BUSY;
+     }
+
+     uint8_t i = ubx_jobs_head % UBX_CFG_QUEUE_LEN;
+     ubx_jobs[i].frame       = frame;
+     ubx_jobs[i].len         = frame_len;
+     ubx_jobs[i].state       = UBX_JOB_QUEUED;
+     ubx_jobs[i].tries_left  = retries + 1;
+     ubx_jobs[i].ack_timeout = ack_timeout_ms;
+     ubx_jobs[i].t_due       = HAL_GetTick();
+     ubx_jobs[i].cb          = cb;
+     ubx_job_done[i] = false;
+     ubx_jobs_head++;
+     ubx_cfg_stats.submitted++;
+     ubx_unlock(pm);
+     return UBX_OK;
+ }
+
+ static void ubx_cfg_finish(uint8_t i, ubx_status_t r)
+ {
+     ubx_job_done[i] = true;
+     if (r != UBX_OK && ubx_cfg_errors < 0xFF) ubx_cfg_errors++;
+
+     // liberar los terminados en orden
+     while (ubx_jobs_tail != ubx_jobs_head && ubx_job_done[ubx_jobs_tail % UBX_CFG_QUEUE_LEN]) {
+         ubx_jobs_tail++;
+     }
  }
 
+ void ubx_cfg_on_ack(uint8_t ack_id, uint8_t cls, uint8_t id)
+ {
+     uint32_t pm = ubx_lock();
+     // el receptor contesta en orden: el ACK es del pedido en vuelo mas viejo con esa class/id
+     for (uint8_t n = ubx_jobs_tail; n != ubx_jobs_head; n++) {
+         uint8_t i = n % UBX_CFG_QUEUE_LEN;
+         ubx_cfg_job_t *j = &ubx_jobs[i];
+         if (ubx_job_done[i] || j->state != UBX_JOB_INFLIGHT) continue;
+         if (j->frame[2] != cls || j->frame[3] != id) continue;
+
+         if (ack_id == 0x01) {
+             ubx_cfg_stats.acked++;
+             ubx_cfg_finish(i, UBX_OK);
+         } else {
+             ubx_cfg_stats.naked++;          // NAK no es transitorio: no se reintenta
+             ubx_cfg_finish(i, UBX_ERR_NAK);
+         }
+         break;
+     }
+     ubx_unlock(pm);
+ }
+
+ void ubx_on_frame(uint8_t cls, uint8_t id, const uint8_t *payload, uint16_t len)
+ {
+     uint32_t pm = ubx_lock();
+     for (uint8_t n = ubx_jobs_tail; n != ubx_jobs_head; n++) {
+         uint8_t i = n % UBX_CFG_QUEUE_LEN;
+         ubx_cfg_job_t *j = &ubx_jobs[i];
+         if (ubx_job_done[i] || j->state != UBX_JOB_INFLIGHT || j->cb == NULL) continue;
+         if (j->frame[2] != cls || j->frame[3] != id) continue;
+
+         j->cb(cls, id, payload, len);
+         break;
+     }
+     ubx_unlock(pm);
+ }
+
+ void ubx_cfg_poll(UART_HandleTypeDef *huart)
+ {
+     uint32_t pm = ubx_lock();
+     uint32_t now = HAL_GetTick();
+     uint8_t inflight = 0;
+     int16_t next = -1;
+
+     for (uint8_t n = ubx_jobs_tail; n != ubx_jobs_head; n++) {
+         uint8_t i = n % UBX_CFG_QUEUE_LEN;
+         ubx_cfg_job_t *j = &ubx_jobs[i];
+         if (ubx_job_done[i]) continue;
+
+         if (j->state == UBX_JOB_INFLIGHT) {
+             if ((int32_t)(now - j->t_due) < 0) { inflight++; continue; }
+             // vencio el ACK
+             if (j->tries_left == 0) {
+                 ubx_cfg_stats.timeouts++;
+                 ubx_cfg_finish(i, UBX_ERR_TIMEOUT);
+                 continue;
+             }
+             ubx_cfg_stats.retries++;
+             j->state = UBX_JOB_QUEUED;
+             j->t_due = now + UBX_CFG_BACKOFF_MS;
+         }
+         if (next < 0 && (int32_t)(now - j->t_due) >= 0) next = i;
+     }
+
+     // sin nada listo, ventana llena o sigue saliendo el anterior (TxCplt vuelve a llamar)
+     if (next < 0 || inflight >= UBX_CFG_WINDOW || huart->gState != HAL_UART_STATE_READY) {
+         ubx_unlock(pm);
+         return;
+     }
+
+     // el frame sale entero por DMA (DMA1 canal 4) directo desde flash
+     ubx_cfg_job_t *j = &ubx_jobs[next];
+     if (HAL_UART_Transmit_DMA(huart, j->frame, j->len) != HAL_OK) {
+         ubx_cfg_finish((uint8_t)next, UBX_ERR_TX);
+     } else {
+         j->tries_left--;
+         j->state = UBX_JOB_INFLIGHT;
+         j->t_due = now + j->ack_timeout;
+         ubx_cfg_stats.sent++;
+     }
+     ubx_unlock(pm);
+ }
+
+ bool ubx_cfg_idle(void)
+ {
+     return ubx_jobs_tail == ubx_jobs_head;
+ }
+
+ uint8_t ubx_cfg_take_errors(void)
+ {
+     uint32_t pm = ubx_lock();
+     uint8_t e = ubx_cfg_errors;
+     ubx_cfg_errors = 0;
+     ubx_unlock(pm);
+     return e;
+ }
+
+ ubx_cfg_stats_t ubx_cfg_get_stats(void)
+ {
+     return ubx_cfg_stats;
+ }
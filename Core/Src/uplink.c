@@ -0,0 +1,154 @@
+/*
+ * uplink.c
+ *
+ *  Created on: Oct 16, 2026
+ *      Author: Tomas Oss
+ */
+
+#include "uplink.h"
+#include "timebase.h"
+
+// Cola de puntos clave: la llena y la vacia el lazo principal, no hace falta proteccion
+static track_point_t uplink_queue[UPLINK_QUEUE_LEN];
+static uint8_t uplink_head;     // mas viejo
+static uint8_t uplink_count;
+static uint8_t uplink_inflight; // de la cabeza, codificados por Uplink_EncodeTrack y en el aire
+static uint32_t uplink_dropped;
+
+static void put_u16(uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)(v);
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)(v);
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t uplink_time(uint32_t tick)
+{
+    uint64_t epoch_ms = Timebase_TickToEpochMs(tick);
+    if (epoch_ms == 0) return (tick / 1000u) | UPLINK_TIME_NO_UTC;
+    return (uint32_t)(epoch_ms / 1000u);
+}
+
+uint8_t Uplink_EncodeFix(const GPS_t *fix, uint8_t *buf, uint8_t size)
+{
+    if (!fix || !buf || size < UPLINK_FIX_LEN) return 0;
+
+    // cm -> m redondeando, recortado a int16
+    int32_t alt_m = (fix->altitude_cm >= 0) ? (fix->altitude_cm + 50) / 100
+                                            : (fix->altitude_cm - 50) / 100;
+    if (alt_m > INT16_MAX) alt_m = INT16_MAX;
+    if (alt_m < INT16_MIN) alt_m = INT16_MIN;
+
+    uint32_t hdop_x10 = fix->hdop / 10u;
+    if (hdop_x10 > 255u) hdop_x10 = 255u;
+
+    // nudos x1000 -> cm/s: 1 kn = 1852/3600 m/s
+    uint32_t speed_cms = (fix->speed_k * 1852u) / 36000u;
+    if (speed_cms > UINT16_MAX) speed_cms = UINT16_MAX;
+
+    buf[0] = UPLINK_MSG_FIX;
+    put_u32(&buf[1], (uint32_t)fix->latitude);
+    put_u32(&buf[5], (uint32_t)fix->longitude);
+    put_u16(&buf[9], (uint16_t)(int16_t)alt_m);
+    buf[11] = (uint8_t)((fix->satelites > 255) ? 255 : fix->satelites);
+    buf[12] = (uint8_t)hdop_x10;
+    put_u16(&buf[13], (uint16_t)speed_cms);
+    buf[15] = (uint8_t)fix->lock;
+    put_u32(&buf[16], uplink_time(fix->tick_ms));
+
+    return UPLINK_FIX_LEN;
+}
+
+uint8_t Uplink_EncodeFence(const geofence_event_t *ev, uint8_t *buf, uint8_t size)
+{
+    if (!ev || !buf || size < UPLINK_FENCE_LEN) return 0;
+
+    buf[0] = UPLINK_MSG_FENCE;
+    buf[1] = ev->id;
+    buf[2] = ev->type;
+    buf[3] = ev->alarm ? 1u : 0u;
+    put_u32(&buf[4], (uint32_t)ev->lat);
+    put_u32(&buf[8], (uint32_t)ev->lon);
+    put_u32(&buf[12], uplink_time(ev->t_ms));
+
+    return UPLINK_FENCE_LEN;
+}
+
+void Uplink_QueuePoint(const track_point_t *p)
+{
+    if (uplink_count == UPLINK_QUEUE_LEN) {
+        // sin enlace por un rato: se pierde el mas viejo, el recorrido reciente importa mas
+        uplink_head = (uint8_t)((uplink_head + 1u) % UPLINK_QUEUE_LEN);
+        uplink_count--;
+        uplink_dropped++;
+        if (uplink_inflight) uplink_inflight--;
+    }
+    uplink_queue[(uplink_head + uplink_count) % UPLINK_QUEUE_LEN] = *p;
+    uplink_count++;
+}
+
+uint8_t Uplink_Pending(void)
+{
+    return uplink_count;
+}
+
+uint32_t Uplink_OldestMs(void)
+{
+    return uplink_queue[uplink_head].t_ms;
+}
+
+uint32_t Uplink_Dropped(void)
+{
+    return uplink_dropped;
+}
+
+uint8_t Uplink_EncodeTrack(uint8_t *buf, uint8_t size, uint8_t *count)
+{
+    *count = 0;
+    if (!buf || uplink_count == 0 || size < UPLINK_TRACK_HDR_LEN) return 0;
+
+    const track_point_t *prev = &uplink_queue[uplink_head];
+    uint8_t len = UPLINK_TRACK_HDR_LEN;
+    uint8_t n = 1;
+
+    buf[0] = UPLINK_MSG_TRACK;
+    put_u32(&buf[2], (uint32_t)prev->lat);
+    put_u32(&buf[6], (uint32_t)prev->lon);
+    put_u32(&buf[10], uplink_time(prev->t_ms));
+
+    while (n < uplink_count && n < UPLINK_TRACK_BATCH && (uint16_t)(len + UPLINK_TRACK_PT_LEN) <= size) {
+        const track_point_t *p = &uplink_queue[(uplink_head + n) % UPLINK_QUEUE_LEN];
+        int32_t dlat = p->lat - prev->lat;
+        int32_t dlon = p->lon - prev->lon;
+        uint32_t dt = p->t_ms / 1000u - prev->t_ms / 1000u;
+        if (dlat > INT16_MAX || dlat < INT16_MIN || dlon > INT16_MAX || dlon < INT16_MIN || dt > UINT16_MAX) break;
+
+        put_u16(&buf[len], (uint16_t)(int16_t)dlat);
+        put_u16(&buf[len + 2], (uint16_t)(int16_t)dlon);
+        put_u16(&buf[len + 4], (uint16_t)dt);
+        len += UPLINK_TRACK_PT_LEN;
+        prev = p;
+        n++;
+    }
+    buf[1] = n;
+    *count = n;
+    uplink_inflight = n;
+    return len;
+}
+
+void Uplink_Release(uint8_t count)
+{
+    // la TX no bloquea: si mientras tanto se descarto alguno por cola llena, ya no esta
+    if (count > uplink_inflight) count = uplink_inflight;
+    uplink_inflight = 0;
+    if (count > uplink_count) count = uplink_count;
+    uplink_head = (uint8_t)((uplink_head + count) % UPLINK_QUEUE_LEN);
+    uplink_count -= count;
+}
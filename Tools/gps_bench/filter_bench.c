@@ -0,0 +1,294 @@
+/*
+ * filter_bench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Banco del filtro de posicion (gps_filter.c) en el host.
+ *   @track    recorrido sintetico con posicion verdadera conocida: caminata, pastoreo y
+ *             descanso a 5 Hz, ruido correlacionado (~HDOP) y saltos de multipath.
+ *             Informa error RMS / maximo crudo vs filtrado y largo del recorrido.
+ *   archivo   log NMEA grabado (GGA): sin verdad, informa largo del recorrido crudo vs
+ *             filtrado (el ruido lo infla) y los outliers descartados.
+ * En ambos casos mide ns por actualizacion del host (promedio y peor caso).
+ *
+ * Despues pasa el recorrido filtrado por la simplificacion (track.c) con varios
+ * errores admitidos: puntos que quedan, relacion de compresion y error maximo real
+ * entre cada fix filtrado y el recorrido reconstruido con los puntos clave.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "gps.h"
+#include "gps_filter.h"
+#include "track.h"
+
+#define TRACK_LAT0   (-345871000)
+#define TRACK_LON0   (-584012000)
+
+typedef struct {
+	gps_coord_t lat, lon;       // medicion
+	gps_coord_t true_lat, true_lon;
+	uint16_t hdop;
+	uint8_t sats;
+	uint32_t t_ms;
+	bool has_truth;
+} bench_fix_t;
+
+typedef struct {
+	double err2_raw, err2_filt, max_raw, max_filt;
+	double len_raw, len_filt, len_true;
+	uint64_t ns, ns_max;
+	uint32_t n, outliers, resets;
+} bench_result_t;
+
+static uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// distancia en m entre dos coordenadas 1e-7 (equirectangular, alcanza para metros)
+static double dist_m(gps_coord_t lat1, gps_coord_t lon1, gps_coord_t lat2, gps_coord_t lon2){
+	double k = 111320.0 / GPS_COORD_SCALE;
+	double dy = (lat2 - lat1) * k;
+	double dx = (lon2 - lon1) * k * cos(lat1 / (double)GPS_COORD_SCALE * M_PI / 180.0);
+	return sqrt(dx * dx + dy * dy);
+}
+
+static uint32_t rng = 17;
+static int32_t rnd(int32_t lim){          // uniforme en [-lim, lim]
+	rng = rng * 1103515245u + 12345u;
+	return (int32_t)((rng >> 8) % (uint32_t)(2 * lim + 1)) - lim;
+}
+static int32_t rnd_normal(int32_t sigma){ // suma de 4 uniformes ~ normal
+	return (rnd(sigma) + rnd(sigma) + rnd(sigma) + rnd(sigma)) * 87 / 100;
+}
+
+// Recorrido sintetico a 5 Hz: 2 min caminando, 5 min pastoreando, 5 min echado, 2 min caminando
+static size_t track_make(bench_fix_t **out){
+	const uint32_t n = (2 + 5 + 5 + 2) * 60 * 5;
+	bench_fix_t *v = calloc(n, sizeof(*v));
+	double lat = TRACK_LAT0, lon = TRACK_LON0, hdg = 0.6;
+	int32_t bias_x = 0, bias_y = 0;         // ruido correlacionado (mm)
+	uint32_t jump = 0;
+	int32_t jx = 0, jy = 0;
+
+	for (uint32_t i = 0; i < n; i++) {
+		uint32_t t = i * 200;
+		double speed;                       // m/s
+		if (t < 120000) speed = 1.2;
+		else if (t < 420000) speed = (i % 25 < 5) ? 0.4 : 0.0;   // pasos sueltos
+		else if (t < 720000) speed = 0.0;
+		else speed = 1.2;
+		hdg += rnd(100) / 5000.0;
+
+		lat += speed * 0.2 * cos(hdg) / 0.011132 ;                              // 1e-7 grados
+		lon += speed * 0.2 * sin(hdg) / (0.011132 * cos(TRACK_LAT0 / 1e7 * M_PI / 180.0));
+
+		uint16_t hdop = (uint16_t)(90 + (i / 300 % 4) * 40);                  // 0.9 .. 2.1
+		bias_x = bias_x * 95 / 100 + rnd_normal(hdop * 4);
+		bias_y = bias_y * 95 / 100 + rnd_normal(hdop * 4);
+		int32_t nx = bias_x + rnd_normal(hdop * 6);
+		int32_t ny = bias_y + rnd_normal(hdop * 6);
+		if (jump == 0 && rnd(1000) > 996) {  // multipath: 20..80 m durante 1..3 fixes
+			jump = 1 + (uint32_t)(rnd(1) + 1);
+			jx = rnd(80000); jy = rnd(80000);
+			if (abs(jx) < 20000) jx = (jx < 0) ? -20000 : 20000;
+		}
+		if (jump) { nx += jx; ny += jy; jump--; }
+
+		v[i].true_lat = (gps_coord_t)lat;
+		v[i].true_lon = (gps_coord_t)lon;
+		v[i].lat = (gps_coord_t)(lat + ny / 11.132);
+		v[i].lon = (gps_coord_t)(lon + nx / (11.132 * cos(TRACK_LAT0 / 1e7 * M_PI / 180.0)));
+		v[i].hdop = hdop;
+		v[i].sats = 8;
+		v[i].t_ms = t;
+		v[i].has_truth = true;
+	}
+	*out = v;
+	return n;
+}
+
+static bool nmea_checksum_ok(const char *line){
+	const char *star = strchr(line, '*');
+	uint8_t sum = 0;
+
+	if (!star) return false;
+	for (const char *p = line + 1; p < star; p++) sum ^= (uint8_t)*p;
+	return strtoul(star + 1, NULL, 16) == sum;
+}
+
+// GGA de un log NMEA: $xxGGA,hhmmss.ss,lat,N,lon,E,q,sats,hdop,...
+static size_t track_load(const char *path, bench_fix_t **out){
+	FILE *f = fopen(path, "rb");
+	char line[256];
+	size_t n = 0, cap = 0;
+	bench_fix_t *v = NULL;
+
+	if (!f) return 0;
+	while (fgets(line, sizeof(line), f)) {
+		if (strlen(line) < 7 || line[0] != '$' || strncmp(&line[3], "GGA,", 4) != 0) continue;
+		if (!nmea_checksum_ok(line)) continue;
+		char *fld[15] = { 0 };
+		int k = 0;
+		for (char *p = line; p && k < 15; k++) {
+			fld[k] = p;
+			p = strchr(p, ',');
+			if (p) *p++ = '\0';
+		}
+		if (k < 10 || fld[6][0] == '0' || fld[2][0] == '\0') continue;
+		if (n == cap) { cap = cap ? cap * 2 : 256; v = realloc(v, cap * sizeof(*v)); }
+
+		double hms = atof(fld[1]);
+		uint32_t s = (uint32_t)hms;
+		bench_fix_t *x = &v[n++];
+		memset(x, 0, sizeof(*x));
+		x->lat = GPS_nmea_to_coord(fld[2], (uint8_t)strlen(fld[2]), fld[3][0]);
+		x->lon = GPS_nmea_to_coord(fld[4], (uint8_t)strlen(fld[4]), fld[5][0]);
+		x->sats = (uint8_t)atoi(fld[7]);
+		x->hdop = (uint16_t)(atof(fld[8]) * 100.0 + 0.5);
+		x->t_ms = ((s / 10000) * 3600 + (s / 100 % 100) * 60 + s % 100) * 1000u
+		        + (uint32_t)((hms - s) * 1000.0 + 0.5);
+	}
+	fclose(f);
+	*out = v;
+	return n;
+}
+
+// distancia en m de c al segmento a-b (plano local en m)
+static double seg_dist_m(const track_point_t *a, const track_point_t *b, gps_coord_t lat, gps_coord_t lon){
+	double k = 111320.0 / GPS_COORD_SCALE, c = cos(a->lat / (double)GPS_COORD_SCALE * M_PI / 180.0);
+	double bx = (b->lon - a->lon) * k * c, by = (b->lat - a->lat) * k;
+	double px = (lon - a->lon) * k * c, py = (lat - a->lat) * k;
+	double l2 = bx * bx + by * by, u = (l2 > 0) ? (px * bx + py * by) / l2 : 0;
+	if (u < 0) u = 0;
+	if (u > 1) u = 1;
+	return hypot(px - u * bx, py - u * by);
+}
+
+// Simplifica los fixes filtrados (lat/lon/t) y mide el error contra el recorrido reconstruido
+static void bench_simplify(const gps_coord_t *lat, const gps_coord_t *lon, const uint32_t *t, size_t n,
+                           uint32_t eps_mm, uint32_t deadband_mm){
+	track_t tr;
+	track_point_t *key = malloc((n + 2) * sizeof(*key)), out[2];
+	size_t nk = 0;
+	uint64_t ns = 0;
+
+	track_init(&tr, eps_mm, deadband_mm);
+	for (size_t i = 0; i < n; i++) {
+		uint64_t t0 = now_ns();
+		uint8_t k = track_push(&tr, lat[i], lon[i], t[i], out);
+		ns += now_ns() - t0;
+		for (uint8_t j = 0; j < k; j++) key[nk++] = out[j];
+	}
+	if (track_flush(&tr, &out[0])) key[nk++] = out[0];
+	if (nk == 0 || key[nk - 1].t_ms != t[n - 1]) {
+		// el ultimo fix (banda muerta) queda representado por el ultimo punto clave
+		key[nk] = key[nk - 1];
+		key[nk].t_ms = t[n - 1];
+		nk++;
+	}
+
+	double emax = 0;
+	size_t s = 0;
+	for (size_t i = 0; i < n; i++) {
+		while (s + 2 < nk && key[s + 1].t_ms <= t[i]) s++;
+		double e = seg_dist_m(&key[s], &key[(s + 1 < nk) ? s + 1 : s], lat[i], lon[i]);
+		if (e > emax) emax = e;
+	}
+	printf("  simplificacion eps %5.1f m banda %4.1f m: %4zu de %zu puntos (%5.1f:1)  error max %5.2f m  %.1f ns/fix\n",
+	       eps_mm / 1000.0, deadband_mm / 1000.0, (size_t)tr.points_out, n, (double)n / tr.points_out, emax,
+	       (double)ns / n);
+	free(key);
+}
+
+static void bench_track(const bench_fix_t *v, size_t n, bench_result_t *r,
+                        gps_coord_t *flat_out, gps_coord_t *flon_out){
+	gps_filter_t f = { 0 };
+	gps_coord_t plat = 0, plon = 0, flat = 0, flon = 0;
+
+	memset(r, 0, sizeof(*r));
+	for (size_t i = 0; i < n; i++) {
+		gps_coord_t lat = v[i].lat, lon = v[i].lon;
+
+		uint64_t t0 = now_ns();
+		gps_filter_update(&f, &lat, &lon, v[i].hdop, v[i].sats, v[i].t_ms);
+		uint64_t dt = now_ns() - t0;
+		r->ns += dt;
+		if (dt > r->ns_max) r->ns_max = dt;
+
+		if (i > 0) {
+			r->len_raw  += dist_m(plat, plon, v[i].lat, v[i].lon);
+			r->len_filt += dist_m(flat, flon, lat, lon);
+			if (v[i].has_truth) r->len_true += dist_m(v[i - 1].true_lat, v[i - 1].true_lon, v[i].true_lat, v[i].true_lon);
+		}
+		if (v[i].has_truth) {
+			double er = dist_m(v[i].true_lat, v[i].true_lon, v[i].lat, v[i].lon);
+			double ef = dist_m(v[i].true_lat, v[i].true_lon, lat, lon);
+			r->err2_raw  += er * er;
+			r->err2_filt += ef * ef;
+			if (er > r->max_raw)  r->max_raw = er;
+			if (ef > r->max_filt) r->max_filt = ef;
+		}
+		plat = v[i].lat; plon = v[i].lon;
+		flat = lat; flon = lon;
+		if (flat_out) { flat_out[i] = lat; flon_out[i] = lon; }
+	}
+	r->n = (uint32_t)n;
+	r->outliers = f.outliers;
+	r->resets = f.resets;
+}
+
+int main(int argc, char **argv){
+	if (argc < 2) {
+		fprintf(stderr, "uso: filter_bench @track | log.nmea ...\n");
+		return 2;
+	}
+	for (int i = 1; i < argc; i++) {
+		bench_fix_t *v = NULL;
+		bench_result_t r;
+		size_t n = (strcmp(argv[i], "@track") == 0) ? track_make(&v) : track_load(argv[i], &v);
+
+		if (n == 0) {
+			fprintf(stderr, "%s: sin fixes GGA\n", argv[i]);
+			free(v);
+			continue;
+		}
+		// varias corridas para el tiempo; los errores son iguales en todas
+		uint64_t best = UINT64_MAX;
+		for (int k = 0; k < 20; k++) {
+			bench_track(v, n, &r, NULL, NULL);
+			if (r.ns < best) best = r.ns;
+		}
+
+		printf("%s\n", argv[i]);
+		printf("  fixes %u  outliers %u  reinicios %u\n", r.n, r.outliers, r.resets);
+		if (v[0].has_truth) {
+			printf("  error RMS  crudo %.2f m  filtrado %.2f m\n", sqrt(r.err2_raw / n), sqrt(r.err2_filt / n));
+			printf("  error max  crudo %.2f m  filtrado %.2f m\n", r.max_raw, r.max_filt);
+			printf("  recorrido  real %.0f m  crudo %.0f m  filtrado %.0f m\n", r.len_true, r.len_raw, r.len_filt);
+		} else {
+			printf("  recorrido  crudo %.0f m  filtrado %.0f m\n", r.len_raw, r.len_filt);
+		}
+		// incluye el costo de clock_gettime alrededor de cada llamada
+		printf("  %.1f ns/actualizacion (host), peor %llu ns\n", (double)best / n, (unsigned long long)r.ns_max);
+
+		gps_coord_t *flat = malloc(n * sizeof(*flat)), *flon = malloc(n * sizeof(*flon));
+		uint32_t *t = malloc(n * sizeof(*t));
+		bench_track(v, n, &r, flat, flon);
+		for (size_t k = 0; k < n; k++) t[k] = v[k].t_ms;
+		static const uint32_t eps[] = { 2000, 5000, 10000, 20000 };
+		for (size_t k = 0; k < sizeof(eps) / sizeof(eps[0]); k++) {
+			bench_simplify(flat, flon, t, n, eps[k], eps[k] * 2 / 5);
+		}
+		free(flat); free(flon); free(t);
+		free(v);
+	}
+	return 0;
+}
@@ -0,0 +1,315 @@
+/*
+ * gps_bench.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Banco de pruebas en el host para el camino de recepcion del GPS.
+ * Reproduce un stream de bytes (archivo del corpus o generado) a traves de
+ * GPS_UART_CallBack tal como lo entrega el DMA circular de USART1:
+ *   - eventos HT / TC cada GPS_DMA_RX_SIZE/2 bytes
+ *   - evento IDLE en cada hueco entre epocas (y ahi corre GPS_Process, como en el main)
+ * El reloj simulado avanza 10 bits por byte a la velocidad negociada, asi los timeouts
+ * y las ventanas de GPS_Process ven el mismo tiempo que en la placa.
+ *
+ * Mide el tiempo de CPU del host (clock_gettime) en el callback ("isr") y en GPS_Process
+ * ("main"). Son ns del host, no del Cortex-M3: sirven para comparar una version del
+ * parser contra otra en la misma maquina (ver "make baseline" / "make compare").
+ *
+ * Corpus: archivos con sentencias tal cual salen del receptor; una linea vacia ("\r\n"
+ * sola) marca el hueco entre epocas y no se transmite. "@ubx" genera un stream NAV
+ * binario (u-blox 6: POSLLH + VELNED + TIMEUTC + STATUS por epoca).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "usart.h"
+#include "gps.h"
+#include "ubx.h"
+#include "hal_stub.h"
+
+#define BENCH_SETTLE_MS    5000     // configuracion terminada si el motor UBX queda quieto esto
+#define BENCH_SETTLE_MAX   120000
+#define BENCH_UBX_EPOCHS   120
+
+typedef struct {
+	const char *name;
+	uint8_t *data;
+	size_t len;
+	size_t *gaps;           // offsets donde va un IDLE (antes del byte en ese offset)
+	size_t ngaps;
+} bench_corpus_t;
+
+typedef struct {
+	uint64_t isr_ns;
+	uint64_t main_ns;
+	uint64_t bytes;
+} bench_time_t;
+
+static uint16_t dma_pos = 0;
+static uint32_t epoch_ms = 1000;
+static bench_time_t *acc = NULL;            // donde se acumulan los tiempos (NULL = no medir)
+
+static uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_event(uint16_t pos){
+	uint64_t t0 = now_ns();
+	GPS_UART_CallBack(pos);
+	uint64_t t1 = now_ns();
+	GPS_Process();
+	uint64_t t2 = now_ns();
+
+	if (acc) {
+		acc->isr_ns  += t1 - t0;
+		acc->main_ns += t2 - t1;
+	}
+}
+
+// Un byte por el "cable": lo escribe el DMA y avanza el reloj
+static void bench_feed(const uint8_t *p, size_t n){
+	uint16_t size;
+	uint8_t *buf = stub_dma_buffer(&size);
+	uint32_t byte_us = stub_byte_us();
+
+	for (size_t i = 0; i < n; i++) {
+		buf[dma_pos++] = p[i];
+		stub_advance_us(byte_us);
+		if (dma_pos == size / 2) {
+			bench_event(dma_pos);                   // HT
+		} else if (dma_pos == size) {
+			bench_event(dma_pos);                   // TC (el DMA vuelve a 0)
+			dma_pos = 0;
+		}
+	}
+	if (acc) acc->bytes += n;
+}
+
+// Fin de rafaga: IDLE, respuestas del receptor a lo que se le mando y espera hasta la proxima epoca
+static void bench_idle(void){
+	uint8_t reply[128];
+	uint16_t n;
+
+	bench_event(dma_pos);
+	bench_time_t *keep = acc;
+	acc = NULL;                                     // los ACK no son parte del corpus
+	while ((n = stub_take_injected(reply, sizeof(reply))) != 0) {
+		bench_feed(reply, n);
+		bench_event(dma_pos);
+	}
+	acc = keep;
+
+	uint32_t t = HAL_GetTick();
+	stub_advance_us((uint64_t)(epoch_ms - t % epoch_ms) * 1000u);
+}
+
+static void bench_replay(const bench_corpus_t *c){
+	size_t from = 0;
+
+	for (size_t g = 0; g < c->ngaps; g++) {
+		bench_feed(c->data + from, c->gaps[g] - from);
+		bench_idle();
+		from = c->gaps[g];
+	}
+	bench_feed(c->data + from, c->len - from);
+	bench_idle();
+}
+
+// GPS_Init y GPS_Process (negociacion + configuracion, en segundo plano) hasta que el motor UBX queda quieto
+static void bench_init(void){
+	huart1.Init.BaudRate = STUB_RECEIVER_BAUD;
+	HAL_UART_Init(&huart1);
+	GPS_Init();
+
+	uint32_t t0 = HAL_GetTick(), quiet = HAL_GetTick();
+	while ((HAL_GetTick() - quiet) < BENCH_SETTLE_MS && (HAL_GetTick() - t0) < BENCH_SETTLE_MAX) {
+		bench_idle();
+		if (!ubx_cfg_idle()) quiet = HAL_GetTick();
+	}
+}
+
+static void corpus_add_gap(bench_corpus_t *c, size_t at){
+	c->gaps = realloc(c->gaps, (c->ngaps + 1) * sizeof(size_t));
+	c->gaps[c->ngaps++] = at;
+}
+
+// Carga un archivo: las lineas "\r\n" solas son huecos y se sacan del stream
+static int corpus_load(bench_corpus_t *c, const char *path){
+	FILE *f = fopen(path, "rb");
+	if (!f) return -1;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	uint8_t *raw = malloc((size_t)size + 1);
+	size_t n = fread(raw, 1, (size_t)size, f);
+	fclose(f);
+
+	memset(c, 0, sizeof(*c));
+	c->name = path;
+	c->data = malloc(n + 1);
+	for (size_t i = 0; i < n; i++) {
+		bool line_start = (i == 0 || raw[i - 1] == '\n');
+		if (line_start && i + 1 < n && raw[i] == '\r' && raw[i + 1] == '\n') {
+			corpus_add_gap(c, c->len);
+			i++;
+			continue;
+		}
+		c->data[c->len++] = raw[i];
+	}
+	free(raw);
+	return 0;
+}
+
+static void put_u16(uint8_t *p, uint16_t v){ p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static void put_u32(uint8_t *p, uint32_t v){ put_u16(p, (uint16_t)v); put_u16(p + 2, (uint16_t)(v >> 16)); }
+
+static void corpus_append_frame(bench_corpus_t *c, uint8_t id, const uint8_t *payload, uint16_t len){
+	c->data = realloc(c->data, c->len + UBX_FRAME_SIZE(len));
+	c->len += ubx_frame_build(c->data + c->len, UBX_FRAME_SIZE(len), UBX_CLASS_NAV, id, payload, len);
+}
+
+// Stream NAV sintetico: un animal caminando al NE a ~1 m/s, fix 3D
+static void corpus_ubx(bench_corpus_t *c){
+	memset(c, 0, sizeof(*c));
+	c->name = "@ubx";
+
+	for (uint32_t e = 0; e < BENCH_UBX_EPOCHS; e++) {
+		uint32_t itow = 475200000u + e * epoch_ms;
+		uint8_t p[UBX_LEN_NAV_VELNED];
+
+		memset(p, 0, sizeof(p));
+		put_u32(&p[0], itow);
+		put_u32(&p[4], (uint32_t)(-584012000 + (int32_t)e * 70));     // lon 1e-7
+		put_u32(&p[8], (uint32_t)(-345871000 + (int32_t)e * 70));     // lat 1e-7
+		put_u32(&p[12], 39400);                                        // height mm
+		put_u32(&p[16], 25200);                                        // hMSL mm
+		put_u32(&p[20], 2500);                                         // hAcc mm
+		put_u32(&p[24], 4000);
+		corpus_append_frame(c, UBX_ID_NAV_POSLLH, p, UBX_LEN_NAV_POSLLH);
+
+		memset(p, 0, sizeof(p));
+		put_u32(&p[0], itow);
+		put_u32(&p[4], 71);                                            // velN cm/s
+		put_u32(&p[8], 71);                                            // velE cm/s
+		put_u32(&p[16], 100);                                          // speed cm/s
+		put_u32(&p[20], 100);                                          // gSpeed cm/s
+		put_u32(&p[24], 4500000);                                      // heading 1e-5 grados
+		corpus_append_frame(c, UBX_ID_NAV_VELNED, p, UBX_LEN_NAV_VELNED);
+
+		memset(p, 0, sizeof(p));
+		put_u32(&p[0], itow);
+		put_u16(&p[12], 2026);
+		p[14] = 10; p[15] = 17;
+		p[16] = 12; p[17] = (uint8_t)((e / 60) % 60); p[18] = (uint8_t)(e % 60);
+		p[19] = 0x07;                                                  // validTOW|WKN|UTC
+		corpus_append_frame(c, UBX_ID_NAV_TIMEUTC, p, UBX_LEN_NAV_TIMEUTC);
+
+		memset(p, 0, sizeof(p));
+		put_u32(&p[0], itow);
+		p[4] = 3;                                                      // gpsFix 3D
+		p[5] = 0x01;                                                   // gpsFixOk
+		corpus_append_frame(c, UBX_ID_NAV_STATUS, p, UBX_LEN_NAV_STATUS);
+
+		corpus_add_gap(c, c->len);
+	}
+}
+
+static void bench_run(const bench_corpus_t *c, unsigned passes, unsigned rounds, bool csv){
+	GPS_Stats_t s0 = GPS_GetStats();
+	bench_time_t best = { 0 };
+
+	// primera pasada: contadores
+	acc = NULL;
+	bench_replay(c);
+	GPS_Stats_t s1 = GPS_GetStats();
+
+	// tiempos: la ronda mas rapida (la que menos interrumpio el sistema operativo)
+	for (unsigned r = 0; r < rounds; r++) {
+		bench_time_t t = { 0 };
+		acc = &t;
+		for (unsigned p = 0; p < passes; p++) bench_replay(c);
+		if (r == 0 || t.isr_ns + t.main_ns < best.isr_ns + best.main_ns) best = t;
+	}
+	acc = NULL;
+	bench_time_t total = best;
+
+	uint32_t ok   = (s1.sentences - s0.sentences) + (s1.ubx_frames - s0.ubx_frames);
+	uint32_t ck   = s1.checksum_errors - s0.checksum_errors;
+	uint32_t mal  = s1.malformed - s0.malformed;
+	uint32_t drop = (s1.dropped_full - s0.dropped_full) + (s1.dropped_long - s0.dropped_long);
+	uint32_t filt = s1.filtered - s0.filtered;
+	uint32_t fix  = s1.fixes - s0.fixes;
+	uint32_t part = s1.epochs_partial - s0.epochs_partial;
+	uint32_t ev   = s1.rx_events - s0.rx_events;
+
+	double ns_all  = (double)(total.isr_ns + total.main_ns);
+	double ns_byte = ns_all / (double)total.bytes;
+	double ns_isr  = (double)total.isr_ns / (double)total.bytes;
+	double ns_main = (double)total.main_ns / (double)total.bytes;
+	double ns_sent = ok ? ns_all / ((double)ok * passes) : 0.0;
+
+	if (csv) {
+		printf("%s,%zu,%u,%u,%u,%u,%u,%u,%u,%u,%.2f,%.2f,%.2f,%.1f\n", c->name, c->len, ev, ok, ck, mal, drop,
+		       filt, fix, part, ns_isr, ns_main, ns_byte, ns_sent);
+		return;
+	}
+	printf("%s\n", c->name);
+	printf("  bytes %zu  eventos %u  huecos %zu  pasadas %u x %u  baud %lu\n", c->len, ev, c->ngaps, rounds, passes,
+	       (unsigned long)huart1.Init.BaudRate);
+	printf("  aceptadas %u  checksum %u  malformadas %u  descartadas %u  filtradas %u\n", ok, ck, mal, drop, filt);
+	printf("  fixes %u  epocas incompletas %u\n", fix, part);
+	printf("  isr %.2f ns/byte  main %.2f ns/byte  total %.2f ns/byte  %.1f ns/sentencia\n",
+	       ns_isr, ns_main, ns_byte, ns_sent);
+}
+
+static void usage(void){
+	fprintf(stderr, "uso: gps_bench [-n pasadas] [-r rondas] [-e epoca_ms] [-c] corpus... (\"@ubx\" = stream NAV generado)\n"
+	                "  los tiempos son los de la ronda (de n pasadas) mas rapida\n"
+	                "  -c  una linea CSV por corpus:\n"
+	                "      nombre,bytes,eventos,aceptadas,checksum,malformadas,descartadas,filtradas,"
+	                "fixes,incompletas,isr_ns_byte,main_ns_byte,ns_byte,ns_sentencia\n");
+}
+
+int main(int argc, char **argv){
+	unsigned passes = 50;
+	unsigned rounds = 5;
+	bool csv = false;
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) passes = (unsigned)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) rounds = (unsigned)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) epoch_ms = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "-c") == 0) csv = true;
+		else { usage(); return 2; }
+	}
+	if (i == argc || passes == 0 || rounds == 0 || epoch_ms == 0) { usage(); return 2; }
+
+	bench_init();
+	if (!csv) {
+		GPS_Stats_t s = GPS_GetStats();
+		printf("GPS_Init: enlace a %lu baud, errores de configuracion %lu\n\n",
+		       (unsigned long)s.baud, (unsigned long)s.cfg_errors);
+	}
+
+	for (; i < argc; i++) {
+		bench_corpus_t c;
+		if (strcmp(argv[i], "@ubx") == 0) {
+			corpus_ubx(&c);
+		} else if (corpus_load(&c, argv[i]) != 0) {
+			fprintf(stderr, "no se puede abrir %s\n", argv[i]);
+			return 1;
+		}
+		bench_run(&c, passes, rounds, csv);
+		free(c.data);
+		free(c.gaps);
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * hal_stub.c
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * HAL de mentira para correr gps.c / ubx.c en el host.
+ * - El reloj (HAL_GetTick) es simulado: avanza con los bytes que pasan por la UART
+ *   a la velocidad configurada y con los HAL_Delay / timeouts, no con el tiempo real.
+ * - Del otro lado de USART1 hay un receptor minimo: contesta ACK-ACK a todo frame UBX
+ *   que le llega a su velocidad y aplica CFG-PRT, asi la busqueda del enlace negocia y la
+ *   configuracion termina sin timeouts. No contesta polls (los settings se reenvian).
+ */
+
+#include <string.h>
+#include "stm32f1xx_hal.h"
+#include "hal_stub.h"
+
+UART_HandleTypeDef huart1;
+DWT_Type stub_dwt;
+CoreDebug_Type stub_core_debug;
+
+static uint64_t stub_time_us = 0;
+static uint32_t stub_rx_baud = STUB_RECEIVER_BAUD;    // velocidad del puerto del receptor
+
+// respuestas a los envios bloqueantes (las lee HAL_UART_Receive)
+static uint8_t stub_reply[64];
+static uint16_t stub_reply_len = 0, stub_reply_pos = 0;
+
+// respuestas a los envios por DMA (el bench las mete en el stream de RX)
+static uint8_t stub_inject[512];
+static uint16_t stub_inject_len = 0;
+
+static uint8_t *stub_dma_buf = NULL;
+static uint16_t stub_dma_size = 0;
+
+void stub_advance_us(uint64_t us){
+	stub_time_us += us;
+}
+
+uint32_t stub_byte_us(void){
+	uint32_t baud = huart1.Init.BaudRate ? huart1.Init.BaudRate : 9600u;
+	return (10u * 1000000u + baud - 1u) / baud;    // 8N1
+}
+
+uint8_t *stub_dma_buffer(uint16_t *size){
+	*size = stub_dma_size;
+	return stub_dma_buf;
+}
+
+uint16_t stub_take_injected(uint8_t *out, uint16_t size){
+	uint16_t n = (stub_inject_len < size) ? stub_inject_len : size;
+	memcpy(out, stub_inject, n);
+	memmove(stub_inject, stub_inject + n, stub_inject_len - n);
+	stub_inject_len -= n;
+	return n;
+}
+
+uint32_t HAL_GetTick(void){
+	return (uint32_t)(stub_time_us / 1000u);
+}
+
+void HAL_Delay(uint32_t ms){
+	stub_time_us += (uint64_t)ms * 1000u;
+}
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin){
+	(void)port; (void)pin;
+}
+
+void Error_Handler(void){
+}
+
+// ACK-ACK para cls/id
+static uint16_t stub_ack(uint8_t *out, uint8_t cls, uint8_t id){
+	uint8_t f[10] = { 0xB5, 0x62, 0x05, 0x01, 0x02, 0x00, cls, id, 0, 0 };
+	uint8_t a = 0, b = 0;
+	for (int i = 2; i < 8; i++) { a += f[i]; b += a; }
+	f[8] = a;
+	f[9] = b;
+	memcpy(out, f, sizeof(f));
+	return sizeof(f);
+}
+
+// El receptor procesa un frame. Devuelve el largo de la respuesta en out (0 = sin respuesta).
+static uint16_t stub_receiver(UART_HandleTypeDef *huart, const uint8_t *f, uint16_t n, uint8_t *out){
+	if (n < 8 || f[0] != 0xB5 || f[1] != 0x62) return 0;
+	if (huart->Init.BaudRate != stub_rx_baud) return 0;     // no lo entiende
+	if (f[2] == 0x06 && f[3] == 0x00 && n == 28) {
+		// CFG-PRT: cambia de velocidad sin ACK (sale a la velocidad nueva y se pierde)
+		memcpy(&stub_rx_baud, &f[14], 4);
+		return 0;
+	}
+	if (f[2] == 0x02 && f[3] == 0x41) return 0;             // RXM-PMREQ no tiene ACK
+	return stub_ack(out, f[2], f[3]);
+}
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart){
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart){
+	huart->gState = HAL_UART_STATE_READY;
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart){
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_AbortReceive_IT(UART_HandleTypeDef *huart){
+	huart->RxState = HAL_UART_STATE_READY;
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size, uint32_t timeout){
+	(void)timeout;
+	stub_time_us += (uint64_t)size * stub_byte_us();
+	stub_reply_len = stub_receiver(huart, data, size, stub_reply);
+	stub_reply_pos = 0;
+	return HAL_OK;
+}
+
+// La transferencia termina en el acto: gState vuelve a READY enseguida
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size){
+	uint8_t r[16];
+	uint16_t n = stub_receiver(huart, data, size, r);
+
+	if (n != 0 && stub_inject_len + n <= sizeof(stub_inject)) {
+		memcpy(stub_inject + stub_inject_len, r, n);
+		stub_inject_len += n;
+	}
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout){
+	(void)huart;
+	if (stub_reply_pos + size <= stub_reply_len) {
+		memcpy(data, stub_reply + stub_reply_pos, size);
+		stub_reply_pos += size;
+		stub_time_us += (uint64_t)size * stub_byte_us();
+		return HAL_OK;
+	}
+	stub_reply_len = stub_reply_pos = 0;
+	stub_time_us += (uint64_t)timeout * 1000u;
+	return HAL_TIMEOUT;
+}
+
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size){
+	stub_dma_buf = data;
+	stub_dma_size = size;
+	huart->RxState = HAL_UART_STATE_BUSY_RX;
+	return HAL_OK;
+}
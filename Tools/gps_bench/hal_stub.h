@@ -0,0 +1,23 @@
+/*
+ * hal_stub.h
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#ifndef HAL_STUB_H_
+#define HAL_STUB_H_
+
+#include <stdint.h>
+
+// Velocidad a la que arranca el receptor simulado (default de fabrica)
+#ifndef STUB_RECEIVER_BAUD
+#define STUB_RECEIVER_BAUD 9600u
+#endif
+
+void stub_advance_us(uint64_t us);
+uint32_t stub_byte_us(void);                        // tiempo de un byte a la velocidad actual de USART1
+uint8_t *stub_dma_buffer(uint16_t *size);           // buffer que GPS_StartRx le dio al DMA
+uint16_t stub_take_injected(uint8_t *out, uint16_t size);  // respuestas del receptor pendientes
+
+#endif /* HAL_STUB_H_ */
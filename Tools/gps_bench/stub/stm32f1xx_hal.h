@@ -0,0 +1,76 @@
+/*
+ * stm32f1xx_hal.h (stub para host)
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ *
+ * Lo minimo del HAL que usan gps.c y ubx.c, para compilarlos en Linux.
+ * La implementacion (reloj simulado, UART, receptor que contesta ACK) esta en hal_stub.c.
+ */
+
+#ifndef STUB_STM32F1XX_HAL_H_
+#define STUB_STM32F1XX_HAL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+
+typedef enum {
+	HAL_UART_STATE_RESET   = 0x00,
+	HAL_UART_STATE_READY   = 0x20,
+	HAL_UART_STATE_BUSY_TX = 0x21,
+	HAL_UART_STATE_BUSY_RX = 0x22
+} HAL_UART_StateTypeDef;
+
+typedef struct { uint32_t BaudRate; } UART_InitTypeDef;
+typedef struct { uint32_t SR; } USART_TypeDef;
+typedef struct {
+	USART_TypeDef *Instance;
+	UART_InitTypeDef Init;
+	volatile HAL_UART_StateTypeDef gState;
+	volatile HAL_UART_StateTypeDef RxState;
+} UART_HandleTypeDef;
+
+typedef struct { uint32_t ODR; } GPIO_TypeDef;
+
+// DWT: en el host CYCCNT queda en 0 (los tiempos los mide el bench con clock_gettime)
+typedef struct { volatile uint32_t CTRL, CYCCNT; } DWT_Type;
+typedef struct { volatile uint32_t DEMCR; } CoreDebug_Type;
+extern DWT_Type stub_dwt;
+extern CoreDebug_Type stub_core_debug;
+#define DWT        (&stub_dwt)
+#define CoreDebug  (&stub_core_debug)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1u << 24)
+#define DWT_CTRL_CYCCNTENA_Msk      (1u << 0)
+
+#define __DMB()          __sync_synchronize()
+#define __disable_irq()  do { } while (0)
+#define __enable_irq()   do { } while (0)
+#define __get_PRIMASK()  (0u)
+#define __set_PRIMASK(x) ((void)(x))
+
+#define UART_FLAG_TC     0x40u
+#define RESET            0u
+#define __HAL_UART_GET_FLAG(h, f)      (1u)
+#define __HAL_UART_CLEAR_OREFLAG(h)    ((void)(h))
+#define __HAL_UART_CLEAR_PEFLAG(h)     ((void)(h))
+#define __HAL_UART_CLEAR_FEFLAG(h)     ((void)(h))
+#define __HAL_UART_CLEAR_NEFLAG(h)     ((void)(h))
+
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t ms);
+void HAL_GPIO_TogglePin(GPIO_TypeDef *port, uint16_t pin);
+void Error_Handler(void);
+
+HAL_StatusTypeDef HAL_UART_Init(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Abort(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_AbortReceive(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_AbortReceive_IT(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *huart, const uint8_t *data, uint16_t size);
+HAL_StatusTypeDef HAL_UART_Receive(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size, uint32_t timeout);
+HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *huart, uint8_t *data, uint16_t size);
+
+#endif /* STUB_STM32F1XX_HAL_H_ */
@@ -0,0 +1,15 @@
+/*
+ * usart.h (stub para host)
+ *
+ *  Created on: Oct 17, 2026
+ *      Author: Tomas Oss
+ */
+
+#ifndef STUB_USART_H_
+#define STUB_USART_H_
+
+#include "stm32f1xx_hal.h"
+
+extern UART_HandleTypeDef huart1;
+
+#endif /* STUB_USART_H_ */